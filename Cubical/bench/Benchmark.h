@@ -0,0 +1,166 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <sys/resource.h>
+
+namespace Cubical
+{
+    //  Result of one benchmark, times in seconds over all repetitions.
+    //  items and bytes are per run, giving the throughput figures, peak is
+    //  the resident high-water mark of the process in bytes while it ran.
+    struct BenchmarkResult
+    {
+        std::string name;
+        size_t size;
+        unsigned int repetitions;
+        double min;
+        double median;
+        double mean;
+        double items;
+        double bytes;
+        size_t peak;
+    };
+
+    //  Self-contained harness, each benchmark is a setup-free callable run
+    //  a fixed number of times after one warm up run. Benchmarks whose
+    //  name does not contain the filter are skipped.
+    class Benchmark
+    {
+        public:
+            Benchmark(unsigned int repetitions = 5, const std::string& filter = "");
+            virtual ~Benchmark() {}
+
+            //  getters and setters
+            const std::vector<BenchmarkResult>& getResults() const { return m_Results; }
+
+            //  times f, items and bytes processed by one call of f
+            void run(const std::string& name, size_t size, double items, double bytes, const std::function<void()>& f);
+
+            void print() const;
+            //  machine readable results for comparison between commits
+            bool save(const std::string& filename, const std::string& label = "") const;
+
+        private:
+            unsigned int m_Repetitions;
+            std::string m_Filter;
+            std::vector<BenchmarkResult> m_Results;
+    };
+
+    //  Resident high-water mark in bytes. On Linux the mark is reset before
+    //  each benchmark through clear_refs, elsewhere it is the process peak.
+    inline size_t getPeakResident()
+    {
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        while(std::getline(status, line))
+        {
+            if(line.compare(0, 6, "VmHWM:") == 0)
+            {
+                std::istringstream value(line.substr(6));
+                size_t kb = 0;
+                value >> kb;
+                return kb * 1024;
+            }
+        }
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return (size_t)usage.ru_maxrss * 1024;
+    }
+
+    inline void resetPeakResident()
+    {
+        std::ofstream clear("/proc/self/clear_refs");
+        clear << "5";
+    }
+
+    inline Benchmark::Benchmark(unsigned int repetitions, const std::string& filter)
+        : m_Repetitions(std::max(1u, repetitions)), m_Filter(filter)
+    {
+
+    }
+
+    inline void Benchmark::run(const std::string& name, size_t size, double items, double bytes, const std::function<void()>& f)
+    {
+        if(name.find(m_Filter) == std::string::npos)
+        {
+            return;
+        }
+        resetPeakResident();
+        f();
+        std::vector<double> times(m_Repetitions);
+        for(unsigned int r = 0; r < m_Repetitions; r++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            f();
+            times[r] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        BenchmarkResult result;
+        result.name = name;
+        result.size = size;
+        result.repetitions = m_Repetitions;
+        result.mean = 0;
+        for(unsigned int r = 0; r < m_Repetitions; r++)
+        {
+            result.mean += times[r] / m_Repetitions;
+        }
+        std::sort(times.begin(), times.end());
+        result.min = times[0];
+        result.median = times[m_Repetitions / 2];
+        result.items = items;
+        result.bytes = bytes;
+        result.peak = getPeakResident();
+        m_Results.push_back(result);
+        std::cout << name << " [" << size << "]: " << result.median * 1e3 << " ms";
+        if(items > 0)
+        {
+            std::cout << ", " << items / result.median / 1e6 << " M items/s";
+        }
+        if(bytes > 0)
+        {
+            std::cout << ", " << bytes / result.median / 1e9 << " GB/s";
+        }
+        std::cout << ", peak " << result.peak / (1 << 20) << " MB" << std::endl;
+    }
+
+    inline void Benchmark::print() const
+    {
+        for(size_t k = 0; k < m_Results.size(); k++)
+        {
+            const BenchmarkResult& r = m_Results[k];
+            std::cout << r.name << "\t" << r.size << "\t" << r.min << "\t" << r.median << "\t" << r.peak << std::endl;
+        }
+    }
+
+    inline bool Benchmark::save(const std::string& filename, const std::string& label) const
+    {
+        std::ofstream file(filename);
+        if(!file)
+        {
+            std::cout << "ERROR! Could not open file " << filename << "!" << std::endl;
+            return false;
+        }
+        file.precision(9);
+        file << "{\n  \"label\": \"" << label << "\",\n  \"benchmarks\": [\n";
+        for(size_t k = 0; k < m_Results.size(); k++)
+        {
+            const BenchmarkResult& r = m_Results[k];
+            file << "    {\"name\": \"" << r.name << "\", \"size\": " << r.size
+                 << ", \"repetitions\": " << r.repetitions
+                 << ", \"min_s\": " << r.min << ", \"median_s\": " << r.median << ", \"mean_s\": " << r.mean
+                 << ", \"items_per_s\": " << (r.items > 0 ? r.items / r.median : 0)
+                 << ", \"bytes_per_s\": " << (r.bytes > 0 ? r.bytes / r.median : 0)
+                 << ", \"peak_rss_bytes\": " << r.peak << "}"
+                 << (k + 1 < m_Results.size() ? ",\n" : "\n");
+        }
+        file << "  ]\n}\n";
+        return (bool)file;
+    }
+
+}
@@ -0,0 +1,355 @@
+//  Benchmarks of the matrix and vector kernels and the persistence
+//  pipeline on synthetic cubical complexes. Build from this directory with
+//
+//      g++ -std=c++17 -O2 -march=native -DNDEBUG -pthread -I../src bench.cpp -o bench
+//
+//  and run as
+//
+//      ./bench [--scale s] [--repetitions r] [--threads t] [--filter name]
+//              [--json file] [--label commit]
+//
+//  NDEBUG selects unchecked element access, see Error.h, so that the
+//  numbers are not those of bounds-checked builds. Problem sizes grow
+//  linearly with scale. With --json the results are written as JSON for
+//  comparison between commits.
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Benchmark.h"
+#include "Matrix.h"
+#include "SparseMatrix.h"
+#include "Vector.h"
+#include "VectorBatch.h"
+#include "BitMatrix.h"
+#include "MatVec.h"
+#include "CubicalComplex.h"
+#include "Persistence.h"
+#include "StreamingPersistence.h"
+#include "MorseComplex.h"
+
+using namespace Cubical;
+
+//  uniform noise on a square grid
+std::vector<double> noiseGrid(unsigned int side, std::mt19937& rng)
+{
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    std::vector<double> grid((size_t)side * side);
+    for(size_t k = 0; k < grid.size(); k++)
+    {
+        grid[k] = uniform(rng);
+    }
+    return grid;
+}
+
+//  distance to a torus or sphere surface in a cube, lightly perturbed
+//  so that the filtration has few ties
+std::vector<double> surfaceGrid(unsigned int side, bool torus, std::mt19937& rng)
+{
+    std::uniform_real_distribution<double> uniform(0.0, 1e-3);
+    std::vector<double> grid((size_t)side * side * side);
+    double c = 0.5 * (side - 1);
+    for(unsigned int z = 0; z < side; z++)
+    {
+        for(unsigned int y = 0; y < side; y++)
+        {
+            for(unsigned int x = 0; x < side; x++)
+            {
+                double px = (x - c) / c, py = (y - c) / c, pz = (z - c) / c;
+                double d;
+                if(torus)
+                {
+                    double ring = std::sqrt(px * px + py * py) - 0.6;
+                    d = std::fabs(std::sqrt(ring * ring + pz * pz) - 0.25);
+                }
+                else
+                {
+                    d = std::fabs(std::sqrt(px * px + py * py + pz * pz) - 0.7);
+                }
+                grid[((size_t)z * side + y) * side + x] = d + uniform(rng);
+            }
+        }
+    }
+    return grid;
+}
+
+Matrix<double> randomMatrix(unsigned int n, unsigned int m, std::mt19937& rng)
+{
+    std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+    Matrix<double> a(n, m);
+    for(unsigned int i = 0; i < n; i++)
+    {
+        for(unsigned int j = 0; j < m; j++)
+        {
+            a(i, j) = uniform(rng);
+        }
+    }
+    return a;
+}
+
+Vector<double> randomVector(unsigned int n, std::mt19937& rng)
+{
+    std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+    std::vector<double> v(n);
+    for(unsigned int i = 0; i < n; i++)
+    {
+        v[i] = uniform(rng);
+    }
+    return Vector<double>(v);
+}
+
+void benchMatrix(Benchmark& bench, unsigned int scale, unsigned int threads, std::mt19937& rng)
+{
+    unsigned int n = 192 * scale;
+    Matrix<double> a = randomMatrix(n, n, rng);
+    Matrix<double> b = randomMatrix(n, n, rng);
+    Matrix<double> c(n, n);
+    double flops = 2.0 * n * n * n;
+    bench.run("matrix/multiply", n, flops, 0, [&]() { Matrix<double> d = a * b; });
+    bench.run("matrix/multiply_into", n, flops, 0, [&]() { c.multiply(a, b, threads); });
+
+    //  many small products, as when composing chain maps
+    const unsigned int products = 4096;
+    for(unsigned int s : {3u, 4u, 8u, 16u})
+    {
+        Matrix<double> x = randomMatrix(s, s, rng);
+        Matrix<double> y = randomMatrix(s, s, rng);
+        Matrix<double> z(s, s);
+        double small = 2.0 * s * s * s * products;
+        bench.run("matrix/multiply_small", s, small, 0, [&]()
+        {
+            for(unsigned int k = 0; k < products; k++)
+            {
+                z.multiply(x, y);
+            }
+        });
+        bench.run("matrix/multiply_small_assign", s, small, 0, [&]()
+        {
+            for(unsigned int k = 0; k < products; k++)
+            {
+                z = x;
+                z *= y;
+            }
+        });
+    }
+
+    double row = sizeof(double) * (double)n;
+    bench.run("matrix/row_add", n, n, 2 * row * n, [&]()
+    {
+        for(unsigned int i = 1; i < n; i++)
+        {
+            c.rowAdd(i, i - 1, 0.5);
+        }
+    });
+    bench.run("matrix/column_add", n, n, 2 * row * n, [&]()
+    {
+        for(unsigned int j = 1; j < n; j++)
+        {
+            c.columnAdd(j, j - 1, 0.5);
+        }
+    });
+    Matrix<double, std::allocator<double>, ColumnMajor> d(c);
+    bench.run("matrix/column_add_column_major", n, n, 2 * row * n, [&]()
+    {
+        for(unsigned int j = 1; j < n; j++)
+        {
+            d.columnAdd(j, j - 1, 0.5);
+        }
+    });
+    bench.run("matrix/transpose", n, (double)n * n, 2 * row * n, [&]() { c.transpose(threads); });
+    bench.run("matrix/to_column_major", n, (double)n * n, 2 * row * n, [&]()
+    {
+        Matrix<double, std::allocator<double>, ColumnMajor> e(a, threads);
+    });
+    bench.run("matrix/row_exchange", n, n, 0, [&]()
+    {
+        for(unsigned int i = 1; i < n; i++)
+        {
+            c.rowExchange(i, i - 1);
+        }
+    });
+    bench.run("matrix/column_exchange", n, n, 2 * row * n, [&]()
+    {
+        for(unsigned int j = 1; j < n; j++)
+        {
+            c.columnExchange(j, j - 1);
+        }
+    });
+    bench.run("matrix/expression", n, (double)n * n, 4 * row * n, [&]() { c = a + b * 2.0 - a; });
+
+    Vector<double> x = randomVector(n, rng);
+    Vector<double> y(std::vector<double>(n, 0.0));
+    bench.run("matrix/matvec", n, 2.0 * n * n, row * n, [&]() { multiply(a, x, y); });
+    bench.run("matrix/matvec_transposed", n, 2.0 * n * n, row * n, [&]() { multiplyTransposed(a, x, y); });
+    bench.run("matrix/matvec_column_major", n, 2.0 * n * n, row * n, [&]() { multiply(d, x, y); });
+    bench.run("matrix/matvec_transposed_column_major", n, 2.0 * n * n, row * n, [&]() { multiplyTransposed(d, x, y); });
+}
+
+void benchVector(Benchmark& bench, unsigned int scale, unsigned int threads, std::mt19937& rng)
+{
+    unsigned int n = (1u << 20) * scale;
+    Vector<double> a = randomVector(n, rng);
+    Vector<double> b = randomVector(n, rng);
+    Vector<double> c(std::vector<double>(n, 0.0));
+    double bytes = sizeof(double) * (double)n;
+    bench.run("vector/expression", n, n, 3 * bytes, [&]() { c = a + b * 2.0; });
+    bench.run("vector/add_assign", n, n, 3 * bytes, [&]() { c += a; });
+    bench.run("vector/scale", n, n, 2 * bytes, [&]() { c *= 0.5; });
+    volatile double sink = 0;
+    bench.run("vector/dot", n, 2.0 * n, 2 * bytes, [&]() { sink = a * b; });
+
+    unsigned int count = (1u << 18) * scale;
+    VectorBatch<double> p(3, count), q(3, count);
+    std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+    for(unsigned int i = 0; i < count; i++)
+    {
+        for(unsigned int k = 0; k < 3; k++)
+        {
+            p.set(i, k, uniform(rng));
+            q.set(i, k, uniform(rng));
+        }
+    }
+    std::vector<double> out(count);
+    bench.run("vector/batch_dot", count, count, 6 * sizeof(double) * (double)count, [&]() { batchDot(p, q, out.data(), threads); });
+    bench.run("vector/batch_normalize", count, count, 6 * sizeof(double) * (double)count, [&]() { batchNormalize(p, threads); });
+    (void)sink;
+}
+
+void benchLoaders(Benchmark& bench, unsigned int scale, std::mt19937& rng)
+{
+    unsigned int n = 256 * scale;
+    Matrix<double> a = randomMatrix(n, n, rng);
+    std::string text = "/tmp/cubical_bench_matrix.txt";
+    std::string binary = "/tmp/cubical_bench_matrix.bin";
+    FILE* file = std::fopen(text.c_str(), "w");
+    if(!file)
+    {
+        std::cout << "ERROR! Could not open file " << text << "!" << std::endl;
+        return;
+    }
+    for(unsigned int i = 0; i < n; i++)
+    {
+        for(unsigned int j = 0; j < n; j++)
+        {
+            std::fprintf(file, j + 1 < n ? "%.17g " : "%.17g\n", a(i, j));
+        }
+    }
+    std::fclose(file);
+    a.save(binary);
+    double bytes = sizeof(double) * (double)n * n;
+    bench.run("load/text", n, (double)n * n, 0, [&]() { Matrix<double> b(text); });
+    bench.run("load/binary", n, (double)n * n, bytes, [&]() { Matrix<double> b(binary); });
+    bench.run("load/sparse_text", n, (double)n * n, 0, [&]() { SparseMatrix<double> b(text); });
+    std::remove(text.c_str());
+    std::remove(binary.c_str());
+}
+
+void benchComplex(Benchmark& bench, const std::string& name, const CubicalComplex<double>& complex, unsigned int threads)
+{
+    size_t cells = complex.getCells();
+    bench.run("complex/" + name + "/boundary", cells, cells, 0, [&]()
+    {
+        for(unsigned int d = 1; d <= complex.getDim(); d++)
+        {
+            SparseMatrix<Z2> boundary = complex.getBoundary<Z2>(d);
+        }
+    });
+    bench.run("persistence/" + name, cells, cells, 0, [&]() { Persistence<double> p(complex); });
+    bench.run("persistence/" + name + "/no_apparent", cells, cells, 0, [&]() { Persistence<double> p(complex, true, false, 1, false); });
+    bench.run("persistence/" + name + "/cohomology", cells, cells, 0, [&]() { Persistence<double> p(complex, true, true); });
+    if(threads > 1)
+    {
+        bench.run("persistence/" + name + "/threads", cells, cells, 0, [&]() { Persistence<double> p(complex, true, false, threads); });
+    }
+    bench.run("persistence/" + name + "/morse", cells, cells, 0, [&]()
+    {
+        MorseComplex<double> morse(complex, threads);
+        std::vector<PersistencePair<double> > pairs = morse.getPersistence();
+    });
+    bench.run("persistence/" + name + "/streaming", cells, cells, 0, [&]() { StreamingPersistence<double> p(complex, (size_t)1 << 24); });
+}
+
+//  column reduction of a packed boundary, whose column additions are a
+//  bit per row when rows are packed and word-wide when columns are
+void benchBits(Benchmark& bench, unsigned int scale, std::mt19937& rng)
+{
+    unsigned int side = 48 * scale;
+    CubicalComplex<double> noise(noiseGrid(side, rng), {side, side});
+    BitMatrix<RowMajor> rows = noise.getBoundaryBits<RowMajor>(2);
+    BitMatrix<ColumnMajor> columns = noise.getBoundaryBits<ColumnMajor>(2);
+    double items = (double)columns.getN() * columns.getM();
+    bench.run("bits/reduce_rows", side, items, 0, [&]() { BitMatrix<RowMajor> a = rows; a.reduceColumns(); });
+    bench.run("bits/reduce_columns", side, items, 0, [&]() { BitMatrix<ColumnMajor> a = columns; a.reduceColumns(); });
+}
+
+void benchPipeline(Benchmark& bench, unsigned int scale, unsigned int threads, std::mt19937& rng)
+{
+    unsigned int side = 192 * scale;
+    CubicalComplex<double> noise(noiseGrid(side, rng), {side, side});
+    benchComplex(bench, "noise", noise, threads);
+
+    unsigned int cube = 32 * scale;
+    CubicalComplex<double> torus(surfaceGrid(cube, true, rng), {cube, cube, cube});
+    benchComplex(bench, "torus", torus, threads);
+    CubicalComplex<double> sphere(surfaceGrid(cube, false, rng), {cube, cube, cube});
+    benchComplex(bench, "sphere", sphere, threads);
+}
+
+int main(int argc, char** argv)
+{
+    unsigned int scale = 1;
+    unsigned int repetitions = 5;
+    unsigned int threads = 1;
+    std::string filter;
+    std::string json;
+    std::string label;
+    for(int k = 1; k + 1 < argc; k += 2)
+    {
+        std::string arg = argv[k];
+        if(arg == "--scale")
+        {
+            scale = std::max(1, std::atoi(argv[k + 1]));
+        }
+        else if(arg == "--repetitions")
+        {
+            repetitions = std::max(1, std::atoi(argv[k + 1]));
+        }
+        else if(arg == "--threads")
+        {
+            threads = std::max(1, std::atoi(argv[k + 1]));
+        }
+        else if(arg == "--filter")
+        {
+            filter = argv[k + 1];
+        }
+        else if(arg == "--json")
+        {
+            json = argv[k + 1];
+        }
+        else if(arg == "--label")
+        {
+            label = argv[k + 1];
+        }
+        else
+        {
+            std::cout << "ERROR! Unknown option " << arg << "!" << std::endl;
+            return 1;
+        }
+    }
+
+    std::mt19937 rng(12345);
+    Benchmark bench(repetitions, filter);
+    benchMatrix(bench, scale, threads, rng);
+    benchVector(bench, scale, threads, rng);
+    benchLoaders(bench, scale, rng);
+    benchBits(bench, scale, rng);
+    benchPipeline(bench, scale, threads, rng);
+
+    if(!json.empty() && !bench.save(json, label))
+    {
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,238 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <unordered_set>
+#include <type_traits>
+
+#include "Stats.h"
+
+namespace Cubical
+{
+    //  Bump allocator. Memory is carved from large chunks and individual
+    //  deallocations do nothing, everything is returned at once by
+    //  release() or when the arena is destroyed. Suits buffers that all
+    //  die together, such as the columns of one reduction phase.
+    class Arena
+    {
+        public:
+            explicit Arena(size_t chunk = (size_t)1 << 20);
+            Arena(const Arena&) = delete;
+            Arena& operator=(const Arena&) = delete;
+            virtual ~Arena() { release(); }
+
+            //  getters and setters
+            size_t getAllocated() const { return m_Allocated; }
+            size_t getChunks() const { return m_Chunks.size(); }
+
+            void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+            void deallocate(void*, size_t) {}
+            //  frees every chunk, all memory from this arena becomes invalid
+            void release();
+
+        private:
+            size_t m_Chunk;
+            size_t m_Allocated;
+            std::vector<char*> m_Chunks;
+            char* m_Current;
+            char* m_End;
+    };
+
+    inline Arena::Arena(size_t chunk) : m_Chunk(chunk), m_Allocated(0), m_Current(nullptr), m_End(nullptr)
+    {
+
+    }
+
+    inline void* Arena::allocate(size_t bytes, size_t alignment)
+    {
+        uintptr_t current = ((uintptr_t)m_Current + alignment - 1) & ~(uintptr_t)(alignment - 1);
+        if(!m_Current || current + bytes > (uintptr_t)m_End)
+        {
+            //  blocks larger than a chunk get a chunk of their own
+            size_t size = std::max(m_Chunk, bytes + alignment);
+            char* chunk = new char[size];
+            CUBICAL_STATS_ADD(chunks, 1);
+            m_Chunks.push_back(chunk);
+            m_Current = chunk;
+            m_End = chunk + size;
+            current = ((uintptr_t)m_Current + alignment - 1) & ~(uintptr_t)(alignment - 1);
+        }
+        m_Current = (char*)(current + bytes);
+        m_Allocated += bytes;
+        return (void*)current;
+    }
+
+    inline void Arena::release()
+    {
+        for(size_t k = 0; k < m_Chunks.size(); k++)
+        {
+            delete[] m_Chunks[k];
+        }
+        m_Chunks.clear();
+        m_Current = nullptr;
+        m_End = nullptr;
+        m_Allocated = 0;
+    }
+
+    //  Size-class pool on top of an arena. Requests are rounded up to a
+    //  power of two from 16 bytes and freed blocks are kept on a list per
+    //  class for reuse. Column buffers grow by doubling, so a column that
+    //  grows and shrinks during a reduction keeps cycling through the same
+    //  few blocks instead of going back to malloc. Blocks above the
+    //  largest class come from the heap. release() frees everything.
+    class Pool
+    {
+        public:
+            static constexpr unsigned int Classes = 16;
+            static constexpr size_t MinBlock = 16;
+
+            explicit Pool(size_t chunk = (size_t)1 << 20);
+            Pool(const Pool&) = delete;
+            Pool& operator=(const Pool&) = delete;
+            virtual ~Pool() { release(); }
+
+            //  getters and setters
+            size_t getAllocated() const { return m_Arena.getAllocated(); }
+
+            void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+            void deallocate(void* block, size_t bytes);
+            //  frees every block, all memory from this pool becomes invalid
+            void release();
+
+        private:
+            struct FreeBlock
+            {
+                FreeBlock* next;
+            };
+
+            Arena m_Arena;
+            FreeBlock* m_Free[Classes];
+            std::unordered_set<void*> m_Large;
+
+            static unsigned int getClass(size_t bytes)
+            {
+                unsigned int k = 0;
+                while((MinBlock << k) < bytes)
+                {
+                    k++;
+                }
+                return k;
+            }
+    };
+
+    inline Pool::Pool(size_t chunk) : m_Arena(chunk)
+    {
+        std::fill(m_Free, m_Free + Classes, nullptr);
+    }
+
+    inline void* Pool::allocate(size_t bytes, size_t alignment)
+    {
+        unsigned int k = getClass(bytes);
+        CUBICAL_STATS_ADD(allocations, 1);
+        CUBICAL_STATS_ADD(allocatedBytes, bytes);
+        if(k >= Classes)
+        {
+            void* block = ::operator new(bytes);
+            m_Large.insert(block);
+            return block;
+        }
+        if(m_Free[k])
+        {
+            FreeBlock* block = m_Free[k];
+            m_Free[k] = block->next;
+            return block;
+        }
+        return m_Arena.allocate(MinBlock << k, std::max(alignment, MinBlock));
+    }
+
+    inline void Pool::deallocate(void* block, size_t bytes)
+    {
+        unsigned int k = getClass(bytes);
+        if(k >= Classes)
+        {
+            m_Large.erase(block);
+            ::operator delete(block);
+            return;
+        }
+        FreeBlock* free = (FreeBlock*)block;
+        free->next = m_Free[k];
+        m_Free[k] = free;
+    }
+
+    inline void Pool::release()
+    {
+        for(void* block : m_Large)
+        {
+            ::operator delete(block);
+        }
+        m_Large.clear();
+        std::fill(m_Free, m_Free + Classes, nullptr);
+        m_Arena.release();
+    }
+
+    //  Standard allocator drawing from an Arena or Pool. The resource is
+    //  not owned and must outlive the containers using it. A default
+    //  constructed allocator has no resource and uses the heap. The
+    //  resource follows containers on copy, move and swap.
+    template<typename T, typename Resource>
+    class ResourceAllocator
+    {
+        public:
+            typedef T value_type;
+            typedef std::true_type propagate_on_container_copy_assignment;
+            typedef std::true_type propagate_on_container_move_assignment;
+            typedef std::true_type propagate_on_container_swap;
+            template<typename U>
+            struct rebind { typedef ResourceAllocator<U, Resource> other; };
+
+            ResourceAllocator() : m_Resource(nullptr) {}
+            ResourceAllocator(Resource* resource) : m_Resource(resource) {}
+            template<typename U>
+            ResourceAllocator(const ResourceAllocator<U, Resource>& other) : m_Resource(other.getResource()) {}
+
+            //  getters and setters
+            Resource* getResource() const { return m_Resource; }
+
+            T* allocate(size_t n)
+            {
+                if(!m_Resource)
+                {
+                    return std::allocator<T>().allocate(n);
+                }
+                return (T*)m_Resource->allocate(n * sizeof(T), alignof(T));
+            }
+            void deallocate(T* p, size_t n)
+            {
+                if(!m_Resource)
+                {
+                    std::allocator<T>().deallocate(p, n);
+                    return;
+                }
+                m_Resource->deallocate(p, n * sizeof(T));
+            }
+
+        private:
+            Resource* m_Resource;
+    };
+
+    template<typename T, typename U, typename Resource>
+    bool operator==(const ResourceAllocator<T, Resource>& a, const ResourceAllocator<U, Resource>& b)
+    {
+        return a.getResource() == b.getResource();
+    }
+
+    template<typename T, typename U, typename Resource>
+    bool operator!=(const ResourceAllocator<T, Resource>& a, const ResourceAllocator<U, Resource>& b)
+    {
+        return a.getResource() != b.getResource();
+    }
+
+    template<typename T>
+    using ArenaAllocator = ResourceAllocator<T, Arena>;
+    template<typename T>
+    using PoolAllocator = ResourceAllocator<T, Pool>;
+
+}
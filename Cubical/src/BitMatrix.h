@@ -0,0 +1,472 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <utility>
+#include <algorithm>
+#include <cstdint>
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+#include "Error.h"
+#include "Matrix.h"
+#include "Z2.h"
+
+namespace Cubical
+{
+    //  a ^= b over n words, vectorised where the target allows
+    inline void xorWords(uint64_t* a, const uint64_t* b, size_t n)
+    {
+        size_t k = 0;
+#if defined(__AVX512F__)
+        for(; k + 8 <= n; k += 8)
+        {
+            __m512i x = _mm512_loadu_si512((const void*)(a + k));
+            __m512i y = _mm512_loadu_si512((const void*)(b + k));
+            _mm512_storeu_si512((void*)(a + k), _mm512_xor_si512(x, y));
+        }
+#endif
+#if defined(__AVX2__)
+        for(; k + 4 <= n; k += 4)
+        {
+            __m256i x = _mm256_loadu_si256((const __m256i*)(a + k));
+            __m256i y = _mm256_loadu_si256((const __m256i*)(b + k));
+            _mm256_storeu_si256((__m256i*)(a + k), _mm256_xor_si256(x, y));
+        }
+#endif
+        for(; k < n; k++)
+        {
+            a[k] ^= b[k];
+        }
+    }
+
+    //  Dense matrix over Z/2 with 64 entries packed per word. Lines, rows
+    //  if row-major and columns if column-major, are stored contiguously
+    //  and exchanged through a line permutation like Matrix<T>. Additions
+    //  and exchanges of lines are word-wide, those across lines touch one
+    //  bit of every line, so column reductions want columns packed.
+    template<Layout L = RowMajor>
+    class BitMatrix
+    {
+        public:
+            //  proxy returned by the mutable element access
+            class Reference
+            {
+                public:
+                    Reference(uint64_t* word, unsigned int bit) : m_Word(word), m_Bit(bit) {}
+                    operator Z2() const { return Z2((int)((*m_Word >> m_Bit) & 1)); }
+                    Reference& operator=(const Z2 value)
+                    {
+                        *m_Word = (*m_Word & ~((uint64_t)1 << m_Bit)) | ((uint64_t)value.getValue() << m_Bit);
+                        return *this;
+                    }
+                    Reference& operator=(const Reference& other) { return (*this) = Z2(other); }
+                    void operator+=(const Z2 value) { *m_Word ^= (uint64_t)value.getValue() << m_Bit; }
+
+                private:
+                    uint64_t* m_Word;
+                    unsigned int m_Bit;
+            };
+
+            BitMatrix();
+            virtual ~BitMatrix();
+            BitMatrix(unsigned int n, unsigned int m);
+            BitMatrix(const Matrix<Z2>& mat);
+
+            //  getters and setters
+            unsigned int getN() const { return m_N; }
+            unsigned int getM() const { return m_M; }
+            //  words per line
+            unsigned int getWords() const { return m_Words; }
+            size_t getNonZeros() const;
+            unsigned int getLineCount() const { return L == RowMajor ? m_N : m_M; }
+            //  packed words of logical line k
+            const uint64_t* getLine(unsigned int k) const { return line(k); }
+
+            //  operator overloads, bounds checked in CUBICAL_CHECKED builds
+            Z2 operator()(unsigned int i, unsigned int j) const;
+            Reference operator()(unsigned int i, unsigned int j);
+
+            //  basic linear algebra
+            void rowExchange(unsigned int i, unsigned int j);
+            void rowMultiply(unsigned int i, const Z2 value);
+            void rowAdd(unsigned int i, unsigned int j, const Z2 value);
+
+            void columnExchange(unsigned int i, unsigned int j);
+            void columnMultiply(unsigned int i, const Z2 value);
+            void columnAdd(unsigned int i, unsigned int j, const Z2 value);
+
+            //  Standard column reduction: every column in turn gets the
+            //  earlier column with its lowest non-zero row added until that
+            //  row is new or the column vanishes. Returns the rank, and the
+            //  lowest row of each reduced column, or -1 if it is zero.
+            unsigned int reduceColumns(std::vector<int>* lowest = nullptr);
+            //  lowest non-zero row of column j, or -1
+            int getLowest(unsigned int j) const;
+
+            //  conversion
+            Matrix<Z2> toDense() const;
+
+            void print();
+
+        private:
+            //  size
+            unsigned int m_N;
+            unsigned int m_M;
+            //  words per line
+            unsigned int m_Words;
+            //  packed lines of m_Words words each
+            std::vector<uint64_t> m_Data;
+            //  physical line of each logical line
+            std::vector<unsigned int> m_Lines;
+
+            uint64_t* line(unsigned int k) { return m_Data.data() + (size_t)m_Lines[k] * m_Words; }
+            const uint64_t* line(unsigned int k) const { return m_Data.data() + (size_t)m_Lines[k] * m_Words; }
+            //  line and bit holding entry (i, j)
+            unsigned int getLineOf(unsigned int i, unsigned int j) const { return L == RowMajor ? i : j; }
+            unsigned int getBitOf(unsigned int i, unsigned int j) const { return L == RowMajor ? j : i; }
+
+            //  operations along lines, word-wide
+            void lineExchange(unsigned int i, unsigned int j);
+            void lineMultiply(unsigned int i, const Z2 value);
+            void lineAdd(unsigned int i, unsigned int j, const Z2 value);
+            //  operations across lines, one bit per line
+            void crossExchange(unsigned int i, unsigned int j);
+            void crossMultiply(unsigned int i, const Z2 value);
+            void crossAdd(unsigned int i, unsigned int j, const Z2 value);
+    };
+
+    template<Layout L>
+    BitMatrix<L>::BitMatrix() : m_N(0), m_M(0), m_Words(0)
+    {
+
+    }
+
+    template<Layout L>
+    BitMatrix<L>::~BitMatrix()
+    {
+
+    }
+
+    template<Layout L>
+    BitMatrix<L>::BitMatrix(unsigned int n, unsigned int m)
+    : m_N(n), m_M(m), m_Words(((L == RowMajor ? m : n) + 63) / 64), m_Lines(getLineCount())
+    {
+        m_Data.assign((size_t)getLineCount() * m_Words, 0);
+        for(unsigned int k = 0; k < m_Lines.size(); k++)
+        {
+            m_Lines[k] = k;
+        }
+    }
+
+    template<Layout L>
+    BitMatrix<L>::BitMatrix(const Matrix<Z2>& mat) : BitMatrix(mat.getN(), mat.getM())
+    {
+        for(unsigned int i = 0; i < m_N; i++)
+        {
+            for(unsigned int j = 0; j < m_M; j++)
+            {
+                unsigned int b = getBitOf(i, j);
+                line(getLineOf(i, j))[b >> 6] |= (uint64_t)mat(i,j).getValue() << (b & 63);
+            }
+        }
+    }
+
+    template<Layout L>
+    size_t BitMatrix<L>::getNonZeros() const
+    {
+        size_t nnz = 0;
+        for(size_t k = 0; k < m_Data.size(); k++)
+        {
+            nnz += __builtin_popcountll(m_Data[k]);
+        }
+        return nnz;
+    }
+
+    template<Layout L>
+    Z2 BitMatrix<L>::operator()(unsigned int i, unsigned int j) const
+    {
+#ifdef CUBICAL_CHECKED
+        if(i >= m_N || j >= m_M)
+        {
+            throwIndexError(i, j, m_N, m_M);
+        }
+#endif
+        unsigned int b = getBitOf(i, j);
+        return Z2((int)((line(getLineOf(i, j))[b >> 6] >> (b & 63)) & 1));
+    }
+
+    template<Layout L>
+    typename BitMatrix<L>::Reference BitMatrix<L>::operator()(unsigned int i, unsigned int j)
+    {
+#ifdef CUBICAL_CHECKED
+        if(i >= m_N || j >= m_M)
+        {
+            throwIndexError(i, j, m_N, m_M);
+        }
+#endif
+        unsigned int b = getBitOf(i, j);
+        return Reference(line(getLineOf(i, j)) + (b >> 6), b & 63);
+    }
+
+    template<Layout L>
+    void BitMatrix<L>::rowExchange(unsigned int i, unsigned int j)
+    {
+        if( i >= m_N || j >= m_N)
+        {
+            std::cout << "ERROR! Rows (" << i << "," << j << ") exceed matrix of size (" << m_N << "," << m_M << ")!" << std::endl;
+            return;
+        }
+        if(L == RowMajor)
+        {
+            lineExchange(i, j);
+        }
+        else
+        {
+            crossExchange(i, j);
+        }
+    }
+
+    template<Layout L>
+    void BitMatrix<L>::rowMultiply(unsigned int i, const Z2 value)
+    {
+        if( i >= m_N)
+        {
+            std::cout << "ERROR! Row " << i << " exceed matrix of size (" << m_N << "," << m_M << ")!" << std::endl;
+            return;
+        }
+        if(L == RowMajor)
+        {
+            lineMultiply(i, value);
+        }
+        else
+        {
+            crossMultiply(i, value);
+        }
+    }
+
+    template<Layout L>
+    void BitMatrix<L>::rowAdd(unsigned int i, unsigned int j, const Z2 value)
+    {
+        if( i >= m_N || j >= m_N)
+        {
+            std::cout << "ERROR! Rows (" << i << "," << j << ") exceed matrix of size (" << m_N << "," << m_M << ")!" << std::endl;
+            return;
+        }
+        if(L == RowMajor)
+        {
+            lineAdd(i, j, value);
+        }
+        else
+        {
+            crossAdd(i, j, value);
+        }
+    }
+
+    template<Layout L>
+    void BitMatrix<L>::columnExchange(unsigned int i, unsigned int j)
+    {
+        if( i >= m_M || j >= m_M)
+        {
+            std::cout << "ERROR! columns (" << i << "," << j << ") exceed matrix of size (" << m_N << "," << m_M << ")!" << std::endl;
+            return;
+        }
+        if(L == ColumnMajor)
+        {
+            lineExchange(i, j);
+        }
+        else
+        {
+            crossExchange(i, j);
+        }
+    }
+
+    template<Layout L>
+    void BitMatrix<L>::columnMultiply(unsigned int i, const Z2 value)
+    {
+        if( i >= m_M)
+        {
+            std::cout << "ERROR! column " << i << " exceed matrix of size (" << m_N << "," << m_M << ")!" << std::endl;
+            return;
+        }
+        if(L == ColumnMajor)
+        {
+            lineMultiply(i, value);
+        }
+        else
+        {
+            crossMultiply(i, value);
+        }
+    }
+
+    template<Layout L>
+    void BitMatrix<L>::columnAdd(unsigned int i, unsigned int j, const Z2 value)
+    {
+        if( i >= m_M || j >= m_M)
+        {
+            std::cout << "ERROR! columns (" << i << "," << j << ") exceed matrix of size (" << m_N << "," << m_M << ")!" << std::endl;
+            return;
+        }
+        if(L == ColumnMajor)
+        {
+            lineAdd(i, j, value);
+        }
+        else
+        {
+            crossAdd(i, j, value);
+        }
+    }
+
+    template<Layout L>
+    void BitMatrix<L>::lineExchange(unsigned int i, unsigned int j)
+    {
+        std::swap(m_Lines[i], m_Lines[j]);
+    }
+
+    template<Layout L>
+    void BitMatrix<L>::lineMultiply(unsigned int i, const Z2 value)
+    {
+        if(!value)
+        {
+            std::fill(line(i), line(i) + m_Words, 0);
+        }
+    }
+
+    template<Layout L>
+    void BitMatrix<L>::lineAdd(unsigned int i, unsigned int j, const Z2 value)
+    {
+        if(value && i != j)
+        {
+            xorWords(line(i), line(j), m_Words);
+        }
+        else if(value)
+        {
+            std::fill(line(i), line(i) + m_Words, 0);
+        }
+    }
+
+    template<Layout L>
+    void BitMatrix<L>::crossExchange(unsigned int i, unsigned int j)
+    {
+        //  swap two bits of every line without branching
+        for(uint64_t* a = m_Data.data(); a != m_Data.data() + m_Data.size(); a += m_Words)
+        {
+            uint64_t diff = ((a[i >> 6] >> (i & 63)) ^ (a[j >> 6] >> (j & 63))) & 1;
+            a[i >> 6] ^= diff << (i & 63);
+            a[j >> 6] ^= diff << (j & 63);
+        }
+    }
+
+    template<Layout L>
+    void BitMatrix<L>::crossMultiply(unsigned int i, const Z2 value)
+    {
+        if(!value)
+        {
+            uint64_t mask = ~((uint64_t)1 << (i & 63));
+            for(uint64_t* a = m_Data.data(); a != m_Data.data() + m_Data.size(); a += m_Words)
+            {
+                a[i >> 6] &= mask;
+            }
+        }
+    }
+
+    template<Layout L>
+    void BitMatrix<L>::crossAdd(unsigned int i, unsigned int j, const Z2 value)
+    {
+        if(!value)
+        {
+            return;
+        }
+        for(uint64_t* a = m_Data.data(); a != m_Data.data() + m_Data.size(); a += m_Words)
+        {
+            a[i >> 6] ^= ((a[j >> 6] >> (j & 63)) & 1) << (i & 63);
+        }
+    }
+
+    template<Layout L>
+    int BitMatrix<L>::getLowest(unsigned int j) const
+    {
+        if(L == ColumnMajor)
+        {
+            const uint64_t* a = line(j);
+            for(unsigned int k = m_Words; k-- > 0;)
+            {
+                if(a[k])
+                {
+                    return 64 * k + 63 - __builtin_clzll(a[k]);
+                }
+            }
+            return -1;
+        }
+        for(unsigned int i = m_N; i-- > 0;)
+        {
+            if((line(i)[j >> 6] >> (j & 63)) & 1)
+            {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    template<Layout L>
+    unsigned int BitMatrix<L>::reduceColumns(std::vector<int>* lowest)
+    {
+        //  column owning each lowest row
+        std::vector<int> owner(m_N, -1);
+        unsigned int rank = 0;
+        if(lowest)
+        {
+            lowest->assign(m_M, -1);
+        }
+        for(unsigned int j = 0; j < m_M; j++)
+        {
+            int low = getLowest(j);
+            while(low >= 0 && owner[low] >= 0)
+            {
+                if(L == ColumnMajor)
+                {
+                    lineAdd(j, owner[low], Z2(1));
+                }
+                else
+                {
+                    crossAdd(j, owner[low], Z2(1));
+                }
+                low = getLowest(j);
+            }
+            if(low >= 0)
+            {
+                owner[low] = j;
+                rank++;
+                if(lowest)
+                {
+                    (*lowest)[j] = low;
+                }
+            }
+        }
+        return rank;
+    }
+
+    template<Layout L>
+    Matrix<Z2> BitMatrix<L>::toDense() const
+    {
+        Matrix<Z2> temp(m_N, m_M);
+        for(unsigned int i = 0; i < m_N; i++)
+        {
+            for(unsigned int j = 0; j < m_M; j++)
+            {
+                unsigned int b = getBitOf(i, j);
+                temp(i,j) = Z2((int)((line(getLineOf(i, j))[b >> 6] >> (b & 63)) & 1));
+            }
+        }
+        return temp;
+    }
+
+    template<Layout L>
+    void BitMatrix<L>::print()
+    {
+        toDense().print();
+    }
+
+}
@@ -0,0 +1,321 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <list>
+#include <deque>
+#include <iostream>
+#include <cstring>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <unordered_map>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "SparseMatrix.h"
+#include "Z2.h"
+
+namespace Cubical
+{
+    //  Store of finished Z/2 columns with a bounded resident size. Columns
+    //  are numbered in the order they are inserted. The most recently used
+    //  columns are kept in memory, and once they and the index of spill
+    //  offsets exceed the budget the least recently used ones are dropped.
+    //  Every dropped column is first written once to a memory-mapped spill
+    //  file, as its row count followed by its rows, and is read back from
+    //  there when it is needed again. Stored columns never change, so a column is
+    //  written at most once however often it is dropped.
+    //
+    //  The spill file is created in the given directory and unlinked at
+    //  once, so it disappears with the store. A column that cannot be
+    //  written stays resident, so nothing is lost when the file cannot
+    //  grow, only the budget is exceeded.
+    class ColumnStore
+    {
+        public:
+            ColumnStore(size_t budget, const std::string& directory = "/tmp");
+            ColumnStore(const ColumnStore&) = delete;
+            ColumnStore& operator=(const ColumnStore&) = delete;
+            virtual ~ColumnStore();
+
+            //  getters and setters
+            //  whether the spill file was created and mapped
+            bool isValid() const { return m_File >= 0 && m_Map; }
+            size_t getBudget() const { return m_Budget; }
+            size_t getColumns() const { return m_Columns; }
+            size_t getResidentBytes() const { return m_Resident + getIndexBytes(); }
+            size_t getPeakResidentBytes() const { return m_Peak; }
+            size_t getSpilledColumns() const { return m_Spilled; }
+            size_t getSpilledBytes() const { return m_Used; }
+            size_t getLoads() const { return m_Loads; }
+
+            //  takes the contents of column, leaving it empty, and returns
+            //  its number
+            unsigned int insert(SparseColumn<Z2>& column);
+            //  column j, valid until the next call to insert or get
+            const SparseColumn<Z2>& get(unsigned int j);
+
+        private:
+            struct Entry
+            {
+                SparseColumn<Z2> column;
+                std::list<unsigned int>::iterator recent;
+            };
+
+            size_t m_Budget;
+            size_t m_Columns;
+            size_t m_Resident;
+            size_t m_Peak;
+            size_t m_Spilled;
+            size_t m_Loads;
+            //  resident columns, most recent at the front of m_Recent
+            std::unordered_map<unsigned int, Entry> m_Entries;
+            std::list<unsigned int> m_Recent;
+            //  offset in the file of every stored column, the maximum until
+            //  it is spilled, grown in chunks rather than by doubling
+            std::deque<uint64_t> m_Offsets;
+            //  spill file and its mapping
+            int m_File;
+            char* m_Map;
+            size_t m_Capacity;
+            size_t m_Used;
+            //  written pages are released in batches, up to m_Released so far
+            static constexpr size_t ReleaseBytes = (size_t)1 << 16;
+            size_t m_Released;
+            //  words of the column being loaded
+            static constexpr size_t LoadWords = 64;
+            std::vector<uint32_t> m_Buffer;
+
+            static size_t getBytes(const SparseColumn<Z2>& column)
+            {
+                return column.getNonZeros() * sizeof(unsigned int) + sizeof(Entry) + 4 * sizeof(void*);
+            }
+            size_t getIndexBytes() const
+            {
+                return m_Offsets.size() * sizeof(uint64_t);
+            }
+            bool isSpilled(unsigned int j) const
+            {
+                return j < m_Offsets.size() && m_Offsets[j] != std::numeric_limits<uint64_t>::max();
+            }
+            Entry& makeResident(unsigned int j, SparseColumn<Z2>& column);
+            void evict(unsigned int keep);
+            bool spill(unsigned int j, const SparseColumn<Z2>& column);
+            void load(unsigned int j, SparseColumn<Z2>& column);
+            bool readWords(size_t offset, size_t words, size_t first = 0);
+            bool grow(size_t bytes);
+            void release(size_t begin, size_t end);
+    };
+
+    inline ColumnStore::ColumnStore(size_t budget, const std::string& directory)
+    : m_Budget(budget), m_Columns(0), m_Resident(0), m_Peak(0), m_Spilled(0), m_Loads(0),
+      m_File(-1), m_Map(nullptr), m_Capacity(0), m_Used(0), m_Released(0)
+    {
+        std::string path = directory + "/cubical-spill-XXXXXX";
+        std::vector<char> name(path.begin(), path.end());
+        name.push_back(0);
+        m_File = mkstemp(name.data());
+        if(m_File < 0)
+        {
+            std::cout << "ERROR! Could not create spill file in " << directory << "!" << std::endl;
+            return;
+        }
+        unlink(name.data());
+        if(!grow(1))
+        {
+            close(m_File);
+            m_File = -1;
+        }
+    }
+
+    inline ColumnStore::~ColumnStore()
+    {
+        if(m_Map)
+        {
+            munmap(m_Map, m_Capacity);
+        }
+        if(m_File >= 0)
+        {
+            close(m_File);
+        }
+    }
+
+    inline unsigned int ColumnStore::insert(SparseColumn<Z2>& column)
+    {
+        //  the column may carry the capacity of a reduction scratch buffer
+        column.shrinkToFit();
+        unsigned int j = m_Columns++;
+        m_Offsets.push_back(std::numeric_limits<uint64_t>::max());
+        makeResident(j, column);
+        evict(j);
+        return j;
+    }
+
+    inline const SparseColumn<Z2>& ColumnStore::get(unsigned int j)
+    {
+        auto it = m_Entries.find(j);
+        if(it != m_Entries.end())
+        {
+            m_Recent.splice(m_Recent.begin(), m_Recent, it->second.recent);
+            return it->second.column;
+        }
+        SparseColumn<Z2> column;
+        load(j, column);
+        Entry& entry = makeResident(j, column);
+        evict(j);
+        return entry.column;
+    }
+
+    inline ColumnStore::Entry& ColumnStore::makeResident(unsigned int j, SparseColumn<Z2>& column)
+    {
+        Entry& entry = m_Entries[j];
+        std::swap(entry.column, column);
+        m_Recent.push_front(j);
+        entry.recent = m_Recent.begin();
+        m_Resident += getBytes(entry.column);
+        m_Peak = std::max(m_Peak, getResidentBytes());
+        return entry;
+    }
+
+    //  drops the least recently used columns other than keep until the
+    //  resident columns fit in the budget
+    inline void ColumnStore::evict(unsigned int keep)
+    {
+        while(getResidentBytes() > m_Budget && m_Recent.size() > 1)
+        {
+            unsigned int j = m_Recent.back();
+            if(j == keep)
+            {
+                break;
+            }
+            auto it = m_Entries.find(j);
+            if(!isSpilled(j) && !spill(j, it->second.column))
+            {
+                break;
+            }
+            m_Resident -= getBytes(it->second.column);
+            m_Recent.pop_back();
+            m_Entries.erase(it);
+        }
+        //  written pages stay in the file but leave the resident set, a
+        //  batch at a time to save system calls
+        if(m_Used - m_Released >= ReleaseBytes)
+        {
+            release(m_Released, m_Used);
+            m_Released = m_Used;
+        }
+    }
+
+    //  writes column j to the end of the file, false if it cannot grow
+    inline bool ColumnStore::spill(unsigned int j, const SparseColumn<Z2>& column)
+    {
+        uint32_t count = column.getNonZeros();
+        size_t bytes = sizeof(uint32_t) * (count + 1);
+        if(!grow(m_Used + bytes))
+        {
+            return false;
+        }
+        uint32_t* out = (uint32_t*)(m_Map + m_Used);
+        out[0] = count;
+        for(uint32_t k = 0; k < count; k++)
+        {
+            out[k + 1] = column.getRow(k);
+        }
+        m_Offsets[j] = m_Used;
+        m_Used += bytes;
+        m_Spilled++;
+        return true;
+    }
+
+    inline void ColumnStore::load(unsigned int j, SparseColumn<Z2>& column)
+    {
+        column.clear();
+        if(!isSpilled(j))
+        {
+            std::cout << "ERROR! Column " << j << " is not in the store!" << std::endl;
+            return;
+        }
+        //  read rather than mapped, as a fault maps the whole folio around
+        //  the column, which would stay resident
+        //  the first read usually holds the whole column
+        size_t words = std::min((size_t)LoadWords, (m_Used - m_Offsets[j]) / sizeof(uint32_t));
+        m_Buffer.resize(std::max(words, m_Buffer.size()));
+        if(!readWords(m_Offsets[j], words))
+        {
+            std::cout << "ERROR! Could not read column " << j << " from spill file!" << std::endl;
+            return;
+        }
+        uint32_t count = m_Buffer[0];
+        if(count + 1 > words)
+        {
+            m_Buffer.resize(count + 1);
+            if(!readWords(m_Offsets[j] + sizeof(uint32_t) * words, count + 1 - words, words))
+            {
+                std::cout << "ERROR! Could not read column " << j << " from spill file!" << std::endl;
+                return;
+            }
+        }
+        for(uint32_t k = 0; k < count; k++)
+        {
+            column.append(m_Buffer[k + 1], Z2(1));
+        }
+        column.shrinkToFit();
+        m_Loads++;
+    }
+
+    //  reads words from offset into m_Buffer at first
+    inline bool ColumnStore::readWords(size_t offset, size_t words, size_t first)
+    {
+        ssize_t bytes = sizeof(uint32_t) * words;
+        return pread(m_File, m_Buffer.data() + first, bytes, offset) == bytes;
+    }
+
+    //  extends the file and its mapping to hold at least bytes, doubling,
+    //  and keeps the old mapping if either step fails
+    inline bool ColumnStore::grow(size_t bytes)
+    {
+        if(bytes <= m_Capacity)
+        {
+            return true;
+        }
+        if(m_File < 0)
+        {
+            return false;
+        }
+        size_t capacity = std::max(bytes, std::max(2 * m_Capacity, (size_t)1 << 20));
+        if(ftruncate(m_File, capacity) != 0)
+        {
+            std::cout << "ERROR! Could not extend spill file to " << capacity << " bytes!" << std::endl;
+            return false;
+        }
+        void* map = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, m_File, 0);
+        if(map == MAP_FAILED)
+        {
+            std::cout << "ERROR! Could not map spill file!" << std::endl;
+            return false;
+        }
+        if(m_Map)
+        {
+            munmap(m_Map, m_Capacity);
+        }
+        m_Map = (char*)map;
+        m_Capacity = capacity;
+        return true;
+    }
+
+    //  unmaps the pages touching [begin, end) from this process,
+    //  their contents are kept by the file
+    inline void ColumnStore::release(size_t begin, size_t end)
+    {
+        size_t page = sysconf(_SC_PAGESIZE);
+        begin = begin / page * page;
+        end = std::min(m_Capacity, (end + page - 1) / page * page);
+        if(m_Map && begin < end)
+        {
+            madvise(m_Map + begin, end - begin, MADV_DONTNEED);
+        }
+    }
+
+}
@@ -0,0 +1,363 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+#include "SparseMatrix.h"
+#include "BitMatrix.h"
+#include "DistanceTransform.h"
+#include "Vector.h"
+#include "Z2.h"
+
+namespace Cubical
+{
+    //  Cubical complex of an n-dimensional grid whose entries are the
+    //  top-dimensional cells. Cells live on the doubled grid of extent
+    //  2 * shape + 1 along each axis, a coordinate is odd where the cell
+    //  spans an interval, so the dimension of a cell is its number of odd
+    //  coordinates and its faces and cofaces are neighbours at distance
+    //  one along its odd and even axes. Only one value per cell is stored,
+    //  the sublevel filtration value, which is the minimum over the top
+    //  cells it bounds. An implicit complex stores only the grid and takes
+    //  that minimum whenever a value is asked for, which is slower but
+    //  needs a value per top cell rather than per cell.
+    template<typename T>
+    class CubicalComplex
+    {
+        public:
+            CubicalComplex<T>();
+            virtual ~CubicalComplex<T>();
+            //  grid values in order of increasing strides, axis 0 fastest
+            CubicalComplex<T>(const std::vector<T>& grid, const std::vector<unsigned int>& shape, bool implicit = false);
+            //  binary grid, set voxels get value 0 and the others value 1
+            static CubicalComplex<T> fromBinary(const std::vector<bool>& grid, const std::vector<unsigned int>& shape);
+            //  point cloud rasterized onto a grid of the given shape, each
+            //  voxel taking its Euclidean distance to the nearest occupied one
+            template<unsigned int N, typename A>
+            static CubicalComplex<T> fromPointCloud(const std::vector<Vector<T, N, A> >& points, const std::vector<unsigned int>& shape,
+                                                    const Vector<T, N, A>& origin, const T spacing, unsigned int threads = 1);
+
+            //  getters and setters
+            unsigned int getDim() const { return m_Shape.size(); }
+            const std::vector<unsigned int>& getShape() const { return m_Shape; }
+            const std::vector<unsigned int>& getExtent() const { return m_Extent; }
+            const std::vector<size_t>& getStrides() const { return m_Strides; }
+            bool isImplicit() const { return !m_Grid.empty(); }
+            size_t getCells() const { return m_Cells; }
+            T getValue(size_t cell) const { return m_Grid.empty() ? m_Values[cell] : computeValue(cell); }
+            //  empty for implicit complexes
+            const std::vector<T>& getValues() const { return m_Values; }
+            //  bytes held by the values or the grid
+            size_t getBytes() const { return (m_Values.size() + m_Grid.size()) * sizeof(T); }
+
+            //  implicit cell structure
+            unsigned int getCellDimension(size_t cell) const;
+            //  writes the 2 * dim faces and their orientation signs, returns dim
+            unsigned int getFaces(size_t cell, size_t* faces, int* signs = nullptr) const;
+            //  writes the cofaces inside the grid, returns their number
+            unsigned int getCofaces(size_t cell, size_t* cofaces) const;
+            //  cells of dimension dim with value at most threshold, in index order
+            std::vector<size_t> getCells(unsigned int dim, const T threshold = std::numeric_limits<T>::max()) const;
+
+            //  boundary operator from dim-cells to (dim - 1)-cells of the
+            //  sublevel set at threshold, indexed in the order of getCells
+            template<typename S>
+            SparseMatrix<S> getBoundary(unsigned int dim, const T threshold = std::numeric_limits<T>::max()) const;
+            //  packed boundary, column-packed for the word-wide column reduction
+            template<Layout L = RowMajor>
+            BitMatrix<L> getBoundaryBits(unsigned int dim, const T threshold = std::numeric_limits<T>::max()) const;
+
+        private:
+            //  grid size, doubled grid size and doubled grid strides
+            std::vector<unsigned int> m_Shape;
+            std::vector<unsigned int> m_Extent;
+            std::vector<size_t> m_Strides;
+            size_t m_Cells;
+            //  filtration value of every cell, or the grid if implicit
+            std::vector<T> m_Values;
+            std::vector<T> m_Grid;
+
+            void computeValues(const std::vector<T>& grid);
+            T computeValue(size_t cell) const;
+    };
+
+    template<typename T>
+    CubicalComplex<T>::CubicalComplex() : m_Cells(0)
+    {
+
+    }
+
+    template<typename T>
+    CubicalComplex<T>::~CubicalComplex()
+    {
+
+    }
+
+    template<typename T>
+    CubicalComplex<T>::CubicalComplex(const std::vector<T>& grid, const std::vector<unsigned int>& shape, bool implicit)
+    : m_Shape(shape), m_Extent(shape.size()), m_Strides(shape.size()), m_Cells(0)
+    {
+        size_t size = 1;
+        size_t cells = 1;
+        for(unsigned int a = 0; a < m_Shape.size(); a++)
+        {
+            m_Extent[a] = 2 * m_Shape[a] + 1;
+            m_Strides[a] = cells;
+            size *= m_Shape[a];
+            cells *= m_Extent[a];
+        }
+        if(m_Shape.empty() || grid.size() != size)
+        {
+            std::cout << "ERROR! Grid of " << grid.size() << " values does not match its shape!" << std::endl;
+            m_Shape.clear();
+            m_Extent.clear();
+            m_Strides.clear();
+            return;
+        }
+        m_Cells = cells;
+        if(implicit)
+        {
+            m_Grid = grid;
+            return;
+        }
+        m_Values.assign(cells, std::numeric_limits<T>::max());
+        computeValues(grid);
+    }
+
+    template<typename T>
+    CubicalComplex<T> CubicalComplex<T>::fromBinary(const std::vector<bool>& grid, const std::vector<unsigned int>& shape)
+    {
+        std::vector<T> temp(grid.size());
+        for(size_t k = 0; k < grid.size(); k++)
+        {
+            temp[k] = grid[k] ? T(0) : T(1);
+        }
+        return CubicalComplex<T>(temp, shape);
+    }
+
+    template<typename T>
+    template<unsigned int N, typename A>
+    CubicalComplex<T> CubicalComplex<T>::fromPointCloud(const std::vector<Vector<T, N, A> >& points, const std::vector<unsigned int>& shape,
+                                                        const Vector<T, N, A>& origin, const T spacing, unsigned int threads)
+    {
+        return CubicalComplex<T>(distanceTransform<T>(rasterize(points, shape, origin, spacing), shape, spacing, threads), shape);
+    }
+
+    //  Top cells take the grid values, then each axis in turn sets the
+    //  cells with an even coordinate on it to the minimum of their two
+    //  neighbours along it. Cells whose even axes are all at most a are
+    //  final after pass a, so one sweep per axis suffices.
+    template<typename T>
+    void CubicalComplex<T>::computeValues(const std::vector<T>& grid)
+    {
+        unsigned int n = m_Shape.size();
+        std::vector<unsigned int> coords(n, 0);
+        for(size_t k = 0; k < grid.size(); k++)
+        {
+            size_t cell = 0;
+            for(unsigned int a = 0; a < n; a++)
+            {
+                cell += (2 * coords[a] + 1) * m_Strides[a];
+            }
+            m_Values[cell] = grid[k];
+            for(unsigned int a = 0; a < n && ++coords[a] == m_Shape[a]; a++)
+            {
+                coords[a] = 0;
+            }
+        }
+        for(unsigned int a = 0; a < n; a++)
+        {
+            size_t stride = m_Strides[a];
+            size_t block = stride * m_Extent[a];
+            for(size_t base = 0; base < m_Values.size(); base += block)
+            {
+                for(unsigned int c = 0; c < m_Extent[a]; c += 2)
+                {
+                    T* cell = m_Values.data() + base + c * stride;
+                    for(size_t r = 0; r < stride; r++)
+                    {
+                        T lower = (c > 0) ? cell[r - stride] : std::numeric_limits<T>::max();
+                        T upper = (c + 1 < m_Extent[a]) ? cell[r + stride] : std::numeric_limits<T>::max();
+                        cell[r] = std::min(lower, upper);
+                    }
+                }
+            }
+        }
+    }
+
+    //  minimum over the top cells around cell, the grid cells at v along
+    //  odd axes 2 v + 1 and at v - 1 and v along even axes 2 v
+    template<typename T>
+    T CubicalComplex<T>::computeValue(size_t cell) const
+    {
+        size_t base = 0;
+        size_t stride = 1;
+        size_t optional[64];
+        unsigned int count = 0;
+        for(unsigned int a = 0; a < m_Shape.size(); a++)
+        {
+            unsigned int c = cell / m_Strides[a] % m_Extent[a];
+            if(c & 1)
+            {
+                base += (c / 2) * stride;
+            }
+            else if(c > 0)
+            {
+                base += (c / 2 - 1) * stride;
+                if(c / 2 < m_Shape[a])
+                {
+                    optional[count++] = stride;
+                }
+            }
+            stride *= m_Shape[a];
+        }
+        T value = std::numeric_limits<T>::max();
+        for(size_t mask = 0; mask < ((size_t)1 << count); mask++)
+        {
+            size_t index = base;
+            for(unsigned int k = 0; k < count; k++)
+            {
+                if((mask >> k) & 1)
+                {
+                    index += optional[k];
+                }
+            }
+            value = std::min(value, m_Grid[index]);
+        }
+        return value;
+    }
+
+    template<typename T>
+    unsigned int CubicalComplex<T>::getCellDimension(size_t cell) const
+    {
+        unsigned int dim = 0;
+        for(unsigned int a = 0; a < m_Shape.size(); a++)
+        {
+            dim += (cell / m_Strides[a] % m_Extent[a]) & 1;
+        }
+        return dim;
+    }
+
+    //  The boundary of a cube I_1 x ... x I_n is the alternating sum over
+    //  its interval factors, the k-th interval contributing
+    //  (-1)^k (upper face - lower face).
+    template<typename T>
+    unsigned int CubicalComplex<T>::getFaces(size_t cell, size_t* faces, int* signs) const
+    {
+        unsigned int dim = 0;
+        for(unsigned int a = 0; a < m_Shape.size(); a++)
+        {
+            if((cell / m_Strides[a] % m_Extent[a]) & 1)
+            {
+                int sign = (dim & 1) ? -1 : 1;
+                faces[2 * dim] = cell - m_Strides[a];
+                faces[2 * dim + 1] = cell + m_Strides[a];
+                if(signs)
+                {
+                    signs[2 * dim] = -sign;
+                    signs[2 * dim + 1] = sign;
+                }
+                dim++;
+            }
+        }
+        return dim;
+    }
+
+    template<typename T>
+    unsigned int CubicalComplex<T>::getCofaces(size_t cell, size_t* cofaces) const
+    {
+        unsigned int count = 0;
+        for(unsigned int a = 0; a < m_Shape.size(); a++)
+        {
+            unsigned int c = cell / m_Strides[a] % m_Extent[a];
+            if(c & 1)
+            {
+                continue;
+            }
+            if(c > 0)
+            {
+                cofaces[count++] = cell - m_Strides[a];
+            }
+            if(c + 1 < m_Extent[a])
+            {
+                cofaces[count++] = cell + m_Strides[a];
+            }
+        }
+        return count;
+    }
+
+    template<typename T>
+    std::vector<size_t> CubicalComplex<T>::getCells(unsigned int dim, const T threshold) const
+    {
+        std::vector<size_t> cells;
+        for(size_t cell = 0; cell < m_Cells; cell++)
+        {
+            if(getCellDimension(cell) == dim && getValue(cell) <= threshold)
+            {
+                cells.push_back(cell);
+            }
+        }
+        return cells;
+    }
+
+    template<typename T>
+    template<typename S>
+    SparseMatrix<S> CubicalComplex<T>::getBoundary(unsigned int dim, const T threshold) const
+    {
+        std::vector<size_t> columns = getCells(dim, threshold);
+        std::vector<size_t> rows;
+        if(dim > 0)
+        {
+            rows = getCells(dim - 1, threshold);
+        }
+        SparseMatrix<S> boundary(rows.size(), columns.size());
+        std::vector<size_t> faces(2 * m_Shape.size());
+        std::vector<int> signs(2 * m_Shape.size());
+        std::vector<std::pair<unsigned int, int> > entries;
+        for(unsigned int j = 0; j < columns.size() && dim > 0; j++)
+        {
+            unsigned int count = 2 * getFaces(columns[j], faces.data(), signs.data());
+            entries.clear();
+            for(unsigned int k = 0; k < count; k++)
+            {
+                unsigned int i = std::lower_bound(rows.begin(), rows.end(), faces[k]) - rows.begin();
+                entries.push_back(std::make_pair(i, signs[k]));
+            }
+            std::sort(entries.begin(), entries.end());
+            for(unsigned int k = 0; k < entries.size(); k++)
+            {
+                boundary.getColumn(j).append(entries[k].first, S(entries[k].second));
+            }
+        }
+        return boundary;
+    }
+
+    template<typename T>
+    template<Layout L>
+    BitMatrix<L> CubicalComplex<T>::getBoundaryBits(unsigned int dim, const T threshold) const
+    {
+        std::vector<size_t> columns = getCells(dim, threshold);
+        std::vector<size_t> rows;
+        if(dim > 0)
+        {
+            rows = getCells(dim - 1, threshold);
+        }
+        BitMatrix<L> boundary(rows.size(), columns.size());
+        std::vector<size_t> faces(2 * m_Shape.size());
+        for(unsigned int j = 0; j < columns.size() && dim > 0; j++)
+        {
+            unsigned int count = 2 * getFaces(columns[j], faces.data());
+            for(unsigned int k = 0; k < count; k++)
+            {
+                unsigned int i = std::lower_bound(rows.begin(), rows.end(), faces[k]) - rows.begin();
+                boundary(i, j) = Z2(1);
+            }
+        }
+        return boundary;
+    }
+
+}
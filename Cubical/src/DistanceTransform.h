@@ -0,0 +1,180 @@
+#pragma once
+
+#include <vector>
+#include <iostream>
+#include <thread>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#include "Vector.h"
+
+namespace Cubical
+{
+    //  Marks the voxels of a grid of the given shape, axis 0 fastest, that
+    //  contain at least one point. Voxel v along axis k covers coordinates
+    //  [origin_k + v * spacing, origin_k + (v + 1) * spacing), points
+    //  outside the grid are ignored.
+    template<typename T, unsigned int N, typename A>
+    std::vector<bool> rasterize(const std::vector<Vector<T, N, A> >& points, const std::vector<unsigned int>& shape,
+                                const Vector<T, N, A>& origin, const T spacing)
+    {
+        size_t size = 1;
+        for(unsigned int k = 0; k < shape.size(); k++)
+        {
+            size *= shape[k];
+        }
+        std::vector<bool> grid(size, false);
+        if(origin.getDim() != shape.size())
+        {
+            std::cout << "ERROR! Points of dimension " << origin.getDim() << " do not fit grid of dimension " << shape.size() << "!" << std::endl;
+            return grid;
+        }
+        for(size_t p = 0; p < points.size(); p++)
+        {
+            const Vector<T, N, A>& point = points[p];
+            if(point.getDim() != shape.size())
+            {
+                continue;
+            }
+            size_t index = 0;
+            size_t stride = 1;
+            bool inside = true;
+            for(unsigned int k = 0; k < shape.size(); k++)
+            {
+                double v = std::floor((double)(point.get(k) - origin.get(k)) / (double)spacing);
+                //  also false for NaN, v is only converted once in range
+                inside = v >= 0 && v < shape[k];
+                if(!inside)
+                {
+                    break;
+                }
+                index += (size_t)v * stride;
+                stride *= shape[k];
+            }
+            if(inside)
+            {
+                grid[index] = true;
+            }
+        }
+        return grid;
+    }
+
+    //  Squared distances along one line by the lower envelope of parabolas
+    //  of Felzenszwalb and Huttenlocher. f holds n squared distances,
+    //  infinite where unknown, v and z are scratch of n and n + 1 entries.
+    inline void distanceTransformLine(const double* f, double* d, unsigned int n, unsigned int* v, double* z)
+    {
+        const double infinity = std::numeric_limits<double>::infinity();
+        int k = -1;
+        for(unsigned int q = 0; q < n; q++)
+        {
+            if(f[q] == infinity)
+            {
+                continue;
+            }
+            if(k < 0)
+            {
+                k = 0;
+                v[0] = q;
+                z[0] = -infinity;
+                z[1] = infinity;
+                continue;
+            }
+            double s = ((f[q] + (double)q * q) - (f[v[k]] + (double)v[k] * v[k])) / (2.0 * q - 2.0 * v[k]);
+            while(s <= z[k])
+            {
+                k--;
+                s = ((f[q] + (double)q * q) - (f[v[k]] + (double)v[k] * v[k])) / (2.0 * q - 2.0 * v[k]);
+            }
+            k++;
+            v[k] = q;
+            z[k] = s;
+            z[k + 1] = infinity;
+        }
+        if(k < 0)
+        {
+            std::fill(d, d + n, infinity);
+            return;
+        }
+        int j = 0;
+        for(unsigned int q = 0; q < n; q++)
+        {
+            while(z[j + 1] < q)
+            {
+                j++;
+            }
+            d[q] = ((double)q - v[j]) * ((double)q - v[j]) + f[v[j]];
+        }
+    }
+
+    //  Exact Euclidean distance from every voxel to the nearest set voxel,
+    //  scaled by spacing. One separable pass per axis applies the line
+    //  transform to every line along that axis, the lines of a pass being
+    //  split across threads. Grids without set voxels are all infinite,
+    //  or the maximum of T if it has no infinity.
+    template<typename T>
+    std::vector<T> distanceTransform(const std::vector<bool>& grid, const std::vector<unsigned int>& shape,
+                                     const T spacing = T(1), unsigned int threads = 1)
+    {
+        std::vector<double> squared(grid.size());
+        for(size_t k = 0; k < grid.size(); k++)
+        {
+            squared[k] = grid[k] ? 0.0 : std::numeric_limits<double>::infinity();
+        }
+        size_t stride = 1;
+        for(unsigned int axis = 0; axis < shape.size(); axis++)
+        {
+            unsigned int n = shape[axis];
+            size_t lines = n > 0 ? grid.size() / n : 0;
+            unsigned int workers = (unsigned int)std::max((size_t)1, std::min((size_t)threads, lines));
+            auto pass = [&, n, stride](size_t begin, size_t end)
+            {
+                std::vector<double> f(n);
+                std::vector<double> d(n);
+                std::vector<unsigned int> v(n);
+                std::vector<double> z(n + 1);
+                for(size_t line = begin; line < end; line++)
+                {
+                    //  first voxel of the line, lines along the axis are
+                    //  stride apart within each block of stride * n voxels
+                    size_t base = (line / stride) * stride * n + line % stride;
+                    for(unsigned int q = 0; q < n; q++)
+                    {
+                        f[q] = squared[base + q * stride];
+                    }
+                    distanceTransformLine(f.data(), d.data(), n, v.data(), z.data());
+                    for(unsigned int q = 0; q < n; q++)
+                    {
+                        squared[base + q * stride] = d[q];
+                    }
+                }
+            };
+            if(workers == 1)
+            {
+                pass(0, lines);
+            }
+            else
+            {
+                std::vector<std::thread> pool;
+                for(unsigned int t = 0; t < workers; t++)
+                {
+                    pool.push_back(std::thread(pass, lines * t / workers, lines * (t + 1) / workers));
+                }
+                for(unsigned int t = 0; t < workers; t++)
+                {
+                    pool[t].join();
+                }
+            }
+            stride *= n;
+        }
+        const T far = std::numeric_limits<T>::has_infinity ? std::numeric_limits<T>::infinity() : std::numeric_limits<T>::max();
+        std::vector<T> distance(grid.size());
+        for(size_t k = 0; k < grid.size(); k++)
+        {
+            distance[k] = squared[k] == std::numeric_limits<double>::infinity() ? far : T(std::sqrt(squared[k]) * spacing);
+        }
+        return distance;
+    }
+
+}
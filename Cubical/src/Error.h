@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+#include <sstream>
+#include <stdexcept>
+
+//  Bounds checking of element access. Builds define CUBICAL_CHECKED or
+//  CUBICAL_UNCHECKED to choose, otherwise access is checked unless NDEBUG
+//  is set. Unchecked access compiles to a plain load.
+#if !defined(CUBICAL_CHECKED) && !defined(CUBICAL_UNCHECKED)
+#ifdef NDEBUG
+#define CUBICAL_UNCHECKED
+#else
+#define CUBICAL_CHECKED
+#endif
+#endif
+
+namespace Cubical
+{
+    //  thrown by checked element access outside of a matrix or vector
+    class IndexError : public std::out_of_range
+    {
+        public:
+            explicit IndexError(const std::string& what) : std::out_of_range(what) {}
+    };
+
+    //  kept out of line and cold so checked accessors stay small
+    [[noreturn]] __attribute__((noinline, cold))
+    inline void throwIndexError(unsigned int i, unsigned int j, unsigned int n, unsigned int m)
+    {
+        std::ostringstream message;
+        message << "Indices (" << i << "," << j << ") exceed matrix of size (" << n << "," << m << ")!";
+        throw IndexError(message.str());
+    }
+
+    [[noreturn]] __attribute__((noinline, cold))
+    inline void throwIndexError(unsigned int i, unsigned int n)
+    {
+        std::ostringstream message;
+        message << "Index " << i << " exceed vector of size " << n << "!";
+        throw IndexError(message.str());
+    }
+}
@@ -0,0 +1,221 @@
+#pragma once
+
+#include <iostream>
+#include <memory>
+
+namespace Cubical
+{
+    //  dimension of vectors whose size is only known at run time
+    const unsigned int Dynamic = 0;
+
+    //  storage order of a dense matrix, a row-major matrix keeps each row
+    //  contiguous and a column-major matrix each column
+    enum Layout { RowMajor, ColumnMajor };
+
+    //  default arguments of the matrix and vector templates
+    template<typename T, typename Alloc = std::allocator<T>, Layout L = RowMajor>
+    class Matrix;
+    template<typename T, unsigned int N = Dynamic, typename Alloc = std::allocator<T> >
+    class Vector;
+
+    //  Lazily evaluated element-wise expressions. Arithmetic on matrices
+    //  and vectors builds a tree of these nodes, which is evaluated in a
+    //  single loop when assigned to a Matrix or Vector. Leaves refer to
+    //  their operands, so an expression must not outlive them.
+    //
+    //  A matrix expression E provides getN(), getM(), isValid(), get(i,j)
+    //  and getRow(i), an object indexable by column. getRow is only used
+    //  once isValid() holds, so it needs no size checks. A vector
+    //  expression provides getDim(), isValid(), get(i), the
+    //  unchecked getUnchecked(i) and Dim, its dimension if known at
+    //  compile time and Dynamic otherwise. Operands of known different
+    //  dimensions are rejected at compile time.
+    template<typename E>
+    struct MatrixExpression
+    {
+        const E& self() const { return static_cast<const E&>(*this); }
+        void print() const { Matrix<typename E::value_type>(self()).print(); }
+    };
+
+    template<typename E>
+    struct VectorExpression
+    {
+        const E& self() const { return static_cast<const E&>(*this); }
+        void print() const { Vector<typename E::value_type>(self()).print(); }
+    };
+
+    //  nodes hold matrices and vectors by reference, other nodes by value
+    template<typename E>
+    struct ExpressionStorage { typedef const E type; };
+    template<typename T, typename Alloc, Layout L>
+    struct ExpressionStorage<Matrix<T, Alloc, L> > { typedef const Matrix<T, Alloc, L>& type; };
+    template<typename T, unsigned int N, typename Alloc>
+    struct ExpressionStorage<Vector<T, N, Alloc> > { typedef const Vector<T, N, Alloc>& type; };
+
+    struct ExpressionAdd
+    {
+        template<typename T>
+        static T apply(const T& a, const T& b) { return a + b; }
+    };
+
+    struct ExpressionSubtract
+    {
+        template<typename T>
+        static T apply(const T& a, const T& b) { return a - b; }
+    };
+
+    //  element-wise l op r, incompatible operands evaluate to l
+    //  as the eager operators did
+    template<typename L, typename R, typename Op>
+    class MatrixBinary : public MatrixExpression<MatrixBinary<L, R, Op> >
+    {
+        public:
+            typedef typename L::value_type value_type;
+
+            struct Row
+            {
+                typename L::Row l;
+                typename R::Row r;
+                value_type operator[](unsigned int j) const { return Op::apply(l[j], r[j]); }
+            };
+
+            MatrixBinary(const L& l, const R& r) : m_L(l), m_R(r)
+            {
+                m_Compatible = (l.getN() == r.getN()) && (l.getM() == r.getM());
+                if(!m_Compatible)
+                {
+                    std::cout << "ERROR! Matrices are not compatible!" << std::endl;
+                }
+            }
+
+            unsigned int getN() const { return m_L.getN(); }
+            unsigned int getM() const { return m_L.getM(); }
+            bool isValid() const { return m_Compatible && m_L.isValid() && m_R.isValid(); }
+            value_type get(unsigned int i, unsigned int j) const
+            {
+                return m_Compatible ? Op::apply(m_L.get(i,j), m_R.get(i,j)) : m_L.get(i,j);
+            }
+            Row getRow(unsigned int i) const { return Row{m_L.getRow(i), m_R.getRow(i)}; }
+
+        private:
+            typename ExpressionStorage<L>::type m_L;
+            typename ExpressionStorage<R>::type m_R;
+            bool m_Compatible;
+    };
+
+    template<typename E>
+    class MatrixScaled : public MatrixExpression<MatrixScaled<E> >
+    {
+        public:
+            typedef typename E::value_type value_type;
+
+            struct Row
+            {
+                typename E::Row e;
+                value_type scalar;
+                value_type operator[](unsigned int j) const { return e[j] * scalar; }
+            };
+
+            MatrixScaled(const E& e, const value_type scalar) : m_E(e), m_Scalar(scalar) {}
+
+            unsigned int getN() const { return m_E.getN(); }
+            unsigned int getM() const { return m_E.getM(); }
+            bool isValid() const { return m_E.isValid(); }
+            value_type get(unsigned int i, unsigned int j) const { return m_E.get(i,j) * m_Scalar; }
+            Row getRow(unsigned int i) const { return Row{m_E.getRow(i), m_Scalar}; }
+
+        private:
+            typename ExpressionStorage<E>::type m_E;
+            value_type m_Scalar;
+    };
+
+    template<typename L, typename R, typename Op>
+    class VectorBinary : public VectorExpression<VectorBinary<L, R, Op> >
+    {
+        public:
+            typedef typename L::value_type value_type;
+            static const unsigned int Dim = L::Dim != Dynamic ? L::Dim : R::Dim;
+            static_assert(L::Dim == Dynamic || R::Dim == Dynamic || L::Dim == R::Dim, "Vectors are not compatible!");
+
+            VectorBinary(const L& l, const R& r) : m_L(l), m_R(r)
+            {
+                m_Compatible = l.getDim() == r.getDim();
+                if(!m_Compatible)
+                {
+                    std::cout << "ERROR! Vectors are not compatible!" << std::endl;
+                }
+            }
+
+            unsigned int getDim() const { return m_L.getDim(); }
+            bool isValid() const { return m_Compatible && m_L.isValid() && m_R.isValid(); }
+            value_type get(unsigned int i) const
+            {
+                return m_Compatible ? Op::apply(m_L.get(i), m_R.get(i)) : m_L.get(i);
+            }
+            //  element access once isValid() holds
+            value_type getUnchecked(unsigned int i) const { return Op::apply(m_L.getUnchecked(i), m_R.getUnchecked(i)); }
+
+        private:
+            typename ExpressionStorage<L>::type m_L;
+            typename ExpressionStorage<R>::type m_R;
+            bool m_Compatible;
+    };
+
+    template<typename E>
+    class VectorScaled : public VectorExpression<VectorScaled<E> >
+    {
+        public:
+            typedef typename E::value_type value_type;
+            static const unsigned int Dim = E::Dim;
+
+            VectorScaled(const E& e, const value_type scalar) : m_E(e), m_Scalar(scalar) {}
+
+            unsigned int getDim() const { return m_E.getDim(); }
+            bool isValid() const { return m_E.isValid(); }
+            value_type get(unsigned int i) const { return m_E.get(i) * m_Scalar; }
+            value_type getUnchecked(unsigned int i) const { return m_E.getUnchecked(i) * m_Scalar; }
+
+        private:
+            typename ExpressionStorage<E>::type m_E;
+            value_type m_Scalar;
+    };
+
+    //  matrix operators
+    template<typename L, typename R>
+    MatrixBinary<L, R, ExpressionAdd> operator+(const MatrixExpression<L>& l, const MatrixExpression<R>& r)
+    {
+        return MatrixBinary<L, R, ExpressionAdd>(l.self(), r.self());
+    }
+
+    template<typename L, typename R>
+    MatrixBinary<L, R, ExpressionSubtract> operator-(const MatrixExpression<L>& l, const MatrixExpression<R>& r)
+    {
+        return MatrixBinary<L, R, ExpressionSubtract>(l.self(), r.self());
+    }
+
+    template<typename E>
+    MatrixScaled<E> operator*(const MatrixExpression<E>& e, const typename E::value_type scalar)
+    {
+        return MatrixScaled<E>(e.self(), scalar);
+    }
+
+    //  vector operators
+    template<typename L, typename R>
+    VectorBinary<L, R, ExpressionAdd> operator+(const VectorExpression<L>& l, const VectorExpression<R>& r)
+    {
+        return VectorBinary<L, R, ExpressionAdd>(l.self(), r.self());
+    }
+
+    template<typename L, typename R>
+    VectorBinary<L, R, ExpressionSubtract> operator-(const VectorExpression<L>& l, const VectorExpression<R>& r)
+    {
+        return VectorBinary<L, R, ExpressionSubtract>(l.self(), r.self());
+    }
+
+    template<typename E>
+    VectorScaled<E> operator*(const VectorExpression<E>& e, const typename E::value_type scalar)
+    {
+        return VectorScaled<E>(e.self(), scalar);
+    }
+
+}
@@ -0,0 +1,260 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <cstring>
+#include <memory>
+#include <algorithm>
+#include <type_traits>
+
+namespace Cubical
+{
+    //  width of the SIMD registers used by the micro-kernel
+#if defined(__AVX512F__)
+    const unsigned int GemmVectorBytes = 64;
+#elif defined(__AVX__)
+    const unsigned int GemmVectorBytes = 32;
+#else
+    const unsigned int GemmVectorBytes = 16;
+#endif
+
+    //  Register and cache blocking of the multiply. Types with a SIMD
+    //  width (4 and 8 byte arithmetic types) use an MR x NR micro-tile
+    //  of two vector registers per row, other types fall back to a
+    //  small scalar tile.
+    template<typename T, bool = std::is_arithmetic<T>::value && (sizeof(T) == 4 || sizeof(T) == 8)>
+    struct GemmBlocking
+    {
+        static constexpr unsigned int MR = 4;
+        static constexpr unsigned int NR = 4;
+        static constexpr unsigned int MC = 64;
+        static constexpr unsigned int KC = 128;
+        static constexpr unsigned int NC = 512;
+    };
+
+    template<typename T>
+    struct GemmBlocking<T, true>
+    {
+        typedef T Vec __attribute__((vector_size(GemmVectorBytes)));
+        static constexpr unsigned int L = GemmVectorBytes / sizeof(T);
+        static constexpr unsigned int MR = 6;
+        static constexpr unsigned int NR = 2 * L;
+        static constexpr unsigned int MC = 96;
+        static constexpr unsigned int KC = 256;
+        static constexpr unsigned int NC = 2048;
+    };
+
+    //  products of at most this many multiply-adds skip the packing
+    const size_t GemmSmall = 10 * 10 * 10;
+
+    //  per-thread packing buffer kept between calls, grown on demand
+    //  and never initialized, every entry is written before it is read
+    template<typename T>
+    struct GemmScratch
+    {
+        std::unique_ptr<T[]> data;
+        size_t size = 0;
+
+        T* get(size_t n)
+        {
+            if(n > size)
+            {
+                data.reset(new T[n]);
+                size = n;
+            }
+            return data.get();
+        }
+    };
+
+    //  C(MR x NR) += A(MR x kc) * B(kc x NR) on packed panels, with
+    //  a stored k-major as a[p * MR + r] and b as b[p * NR + c]
+    template<typename T, bool vector = std::is_arithmetic<T>::value && (sizeof(T) == 4 || sizeof(T) == 8)>
+    struct GemmKernel
+    {
+        typedef GemmBlocking<T> B;
+        static void run(unsigned int kc, const T* a, const T* b, T* c)
+        {
+            T acc[B::MR][B::NR] = {};
+            for(unsigned int p = 0; p < kc; p++)
+            {
+                for(unsigned int r = 0; r < B::MR; r++)
+                {
+                    for(unsigned int s = 0; s < B::NR; s++)
+                    {
+                        acc[r][s] += a[p * B::MR + r] * b[p * B::NR + s];
+                    }
+                }
+            }
+            for(unsigned int r = 0; r < B::MR; r++)
+            {
+                for(unsigned int s = 0; s < B::NR; s++)
+                {
+                    c[r * B::NR + s] += acc[r][s];
+                }
+            }
+        }
+    };
+
+    template<typename T>
+    struct GemmKernel<T, true>
+    {
+        typedef GemmBlocking<T> B;
+        typedef typename B::Vec Vec;
+        static void run(unsigned int kc, const T* a, const T* b, T* c)
+        {
+            Vec acc[B::MR][2] = {};
+            for(unsigned int p = 0; p < kc; p++)
+            {
+                Vec b0;
+                Vec b1;
+                std::memcpy(&b0, b + p * B::NR, sizeof(Vec));
+                std::memcpy(&b1, b + p * B::NR + B::L, sizeof(Vec));
+                for(unsigned int r = 0; r < B::MR; r++)
+                {
+                    T value = a[p * B::MR + r];
+                    acc[r][0] += b0 * value;
+                    acc[r][1] += b1 * value;
+                }
+            }
+            for(unsigned int r = 0; r < B::MR; r++)
+            {
+                Vec c0;
+                Vec c1;
+                std::memcpy(&c0, c + r * B::NR, sizeof(Vec));
+                std::memcpy(&c1, c + r * B::NR + B::L, sizeof(Vec));
+                c0 += acc[r][0];
+                c1 += acc[r][1];
+                std::memcpy(c + r * B::NR, &c0, sizeof(Vec));
+                std::memcpy(c + r * B::NR + B::L, &c1, sizeof(Vec));
+            }
+        }
+    };
+
+    //  C[i0, i1) += A * B for row-major C with row stride m, where a and b
+    //  point to the rows of A (n x k) and B (k x m). Panels of B are packed
+    //  into NR-wide strips and blocks of A into MR-tall strips, zero padded
+    //  at the edges, so the micro-kernel never sees a partial tile. The
+    //  buffers are sized for the operands rather than the blocking.
+    template<typename T>
+    void gemmRows(unsigned int i0, unsigned int i1, unsigned int k, unsigned int m,
+                  const T* const* a, const T* const* b, T* c)
+    {
+        typedef GemmBlocking<T> B;
+        static thread_local GemmScratch<T> scratchA;
+        static thread_local GemmScratch<T> scratchB;
+        size_t depth = std::min(B::KC, k);
+        size_t height = (std::min(B::MC, i1 - i0) + B::MR - 1) / B::MR * B::MR;
+        size_t width = (std::min(B::NC, m) + B::NR - 1) / B::NR * B::NR;
+        T* packA = scratchA.get(height * depth);
+        T* packB = scratchB.get(width * depth);
+        T tile[B::MR * B::NR];
+        for(unsigned int jc = 0; jc < m; jc += B::NC)
+        {
+            unsigned int nc = std::min(B::NC, m - jc);
+            for(unsigned int pc = 0; pc < k; pc += B::KC)
+            {
+                unsigned int kc = std::min(B::KC, k - pc);
+                for(unsigned int jr = 0; jr < nc; jr += B::NR)
+                {
+                    T* panel = packB + (size_t)jr * kc;
+                    for(unsigned int p = 0; p < kc; p++)
+                    {
+                        const T* row = b[pc + p] + jc + jr;
+                        for(unsigned int s = 0; s < B::NR; s++)
+                        {
+                            panel[p * B::NR + s] = (jr + s < nc) ? row[s] : T();
+                        }
+                    }
+                }
+                for(unsigned int ic = i0; ic < i1; ic += B::MC)
+                {
+                    unsigned int mc = std::min(B::MC, i1 - ic);
+                    for(unsigned int ir = 0; ir < mc; ir += B::MR)
+                    {
+                        T* strip = packA + (size_t)ir * kc;
+                        for(unsigned int r = 0; r < B::MR; r++)
+                        {
+                            const T* row = (ir + r < mc) ? a[ic + ir + r] + pc : nullptr;
+                            for(unsigned int p = 0; p < kc; p++)
+                            {
+                                strip[p * B::MR + r] = row ? row[p] : T();
+                            }
+                        }
+                    }
+                    for(unsigned int jr = 0; jr < nc; jr += B::NR)
+                    {
+                        for(unsigned int ir = 0; ir < mc; ir += B::MR)
+                        {
+                            std::fill(tile, tile + B::MR * B::NR, T());
+                            GemmKernel<T>::run(kc, packA + (size_t)ir * kc, packB + (size_t)jr * kc, tile);
+                            unsigned int rows = std::min(B::MR, mc - ir);
+                            unsigned int columns = std::min(B::NR, nc - jr);
+                            for(unsigned int r = 0; r < rows; r++)
+                            {
+                                T* out = c + (size_t)(ic + ir + r) * m + jc + jr;
+                                for(unsigned int s = 0; s < columns; s++)
+                                {
+                                    out[s] += tile[r * B::NR + s];
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    //  C += A * B one row of A at a time, each entry scaling a row of B
+    template<typename T>
+    void gemmSmall(unsigned int n, unsigned int k, unsigned int m,
+                   const T* const* a, const T* const* b, T* c)
+    {
+        for(unsigned int i = 0; i < n; i++)
+        {
+            T* out = c + (size_t)i * m;
+            for(unsigned int p = 0; p < k; p++)
+            {
+                const T value = a[i][p];
+                const T* row = b[p];
+                for(unsigned int j = 0; j < m; j++)
+                {
+                    out[j] += value * row[j];
+                }
+            }
+        }
+    }
+
+    //  C += A * B, splitting the rows of C over the given number of threads.
+    //  Small products, such as compositions of chain maps, go straight to
+    //  the loop above, as packing would cost more than it saves.
+    template<typename T>
+    void gemm(unsigned int n, unsigned int k, unsigned int m,
+              const T* const* a, const T* const* b, T* c, unsigned int threads = 1)
+    {
+        typedef GemmBlocking<T> B;
+        if((size_t)n * k * m <= GemmSmall)
+        {
+            gemmSmall(n, k, m, a, b, c);
+            return;
+        }
+        unsigned int blocks = (n + B::MR - 1) / B::MR;
+        threads = std::max(1u, std::min(threads, blocks));
+        if(threads == 1)
+        {
+            gemmRows(0, n, k, m, a, b, c);
+            return;
+        }
+        std::vector<std::thread> workers;
+        for(unsigned int t = 0; t < threads; t++)
+        {
+            unsigned int i0 = std::min(n, blocks * t / threads * B::MR);
+            unsigned int i1 = std::min(n, blocks * (t + 1) / threads * B::MR);
+            workers.push_back(std::thread(gemmRows<T>, i0, i1, k, m, a, b, c));
+        }
+        for(unsigned int t = 0; t < threads; t++)
+        {
+            workers[t].join();
+        }
+    }
+
+}
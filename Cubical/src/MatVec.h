@@ -0,0 +1,319 @@
+#pragma once
+
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <cstdint>
+
+#include "Matrix.h"
+#include "SparseMatrix.h"
+#include "BitMatrix.h"
+#include "Vector.h"
+#include "VectorBatch.h"
+#include "Z2.h"
+
+namespace Cubical
+{
+    //  y = A x and y = A^T x for dense, sparse and packed Z/2 matrices, as
+    //  when applying a boundary or coboundary map to a chain. The output is
+    //  overwritten and must already have the right dimension, so applying
+    //  a map allocates nothing. x and y must not overlap.
+
+    //  rows of a row-major view dotted with x a SIMD register at a time
+    template<typename T>
+    void multiplyRows(const MatrixView<const T>& a, const T* x, T* y)
+    {
+        typedef BatchLanes<T> V;
+        unsigned int m = a.getM();
+        for(unsigned int i = 0; i < a.getN(); i++)
+        {
+            const T* row = a.getRow(i);
+            typename V::Lane acc = {};
+            unsigned int j = 0;
+            for(; j + V::L <= m; j += V::L)
+            {
+                acc += V::load(row + j) * V::load(x + j);
+            }
+            T sum = V::sum(acc);
+            for(; j < m; j++)
+            {
+                sum += row[j] * x[j];
+            }
+            y[i] = sum;
+        }
+    }
+
+    //  rows of a row-major view scaled by x and accumulated into y
+    template<typename T>
+    void multiplyRowsTransposed(const MatrixView<const T>& a, const T* x, T* y)
+    {
+        typedef BatchLanes<T> V;
+        unsigned int m = a.getM();
+        std::fill(y, y + m, T());
+        for(unsigned int i = 0; i < a.getN(); i++)
+        {
+            const T value = x[i];
+            if(value == T())
+            {
+                continue;
+            }
+            const T* row = a.getRow(i);
+            unsigned int j = 0;
+            for(; j + V::L <= m; j += V::L)
+            {
+                V::store(y + j, V::load(y + j) + V::load(row + j) * value);
+            }
+            for(; j < m; j++)
+            {
+                y[j] += row[j] * value;
+            }
+        }
+    }
+
+    //  Dense matrices run both kernels on contiguous lines. The transposed
+    //  view of a column-major matrix is row-major with its columns as rows,
+    //  so A x accumulates the columns and A^T x dots them.
+    template<typename T, typename A, Layout L>
+    void multiply(const Matrix<T, A, L>& a, const T* x, T* y)
+    {
+        if constexpr(L == RowMajor)
+        {
+            multiplyRows(a.getView(), x, y);
+        }
+        else
+        {
+            multiplyRowsTransposed(a.getTransposedView(), x, y);
+        }
+    }
+
+    template<typename T, typename A, Layout L>
+    void multiplyTransposed(const Matrix<T, A, L>& a, const T* x, T* y)
+    {
+        if constexpr(L == RowMajor)
+        {
+            multiplyRowsTransposed(a.getView(), x, y);
+        }
+        else
+        {
+            multiplyRows(a.getTransposedView(), x, y);
+        }
+    }
+
+    //  columns scattered into y, skipping zero entries of x
+    template<typename T, typename A>
+    void multiply(const SparseMatrix<T, A>& a, const T* x, T* y)
+    {
+        std::fill(y, y + a.getN(), T());
+        for(unsigned int j = 0; j < a.getM(); j++)
+        {
+            const T value = x[j];
+            if(value == T())
+            {
+                continue;
+            }
+            const SparseColumn<T, A>& column = a.getColumn(j);
+            for(unsigned int k = 0; k < column.getNonZeros(); k++)
+            {
+                y[column.getRow(k)] += column.getValue(k) * value;
+            }
+        }
+    }
+
+    //  columns gathered from x
+    template<typename T, typename A>
+    void multiplyTransposed(const SparseMatrix<T, A>& a, const T* x, T* y)
+    {
+        for(unsigned int j = 0; j < a.getM(); j++)
+        {
+            const SparseColumn<T, A>& column = a.getColumn(j);
+            T sum = T();
+            for(unsigned int k = 0; k < column.getNonZeros(); k++)
+            {
+                sum += column.getValue(k) * x[column.getRow(k)];
+            }
+            y[j] = sum;
+        }
+    }
+
+    //  Packed chains over Z/2, x and y hold 64 entries per word. Entry k
+    //  of the result is the parity of line k and x, taken once over their
+    //  xor-ed conjunctions.
+    template<Layout L>
+    void multiplyLines(const BitMatrix<L>& a, const uint64_t* x, uint64_t* y)
+    {
+        unsigned int words = a.getWords();
+        std::fill(y, y + (a.getLineCount() + 63) / 64, (uint64_t)0);
+        for(unsigned int k = 0; k < a.getLineCount(); k++)
+        {
+            const uint64_t* line = a.getLine(k);
+            uint64_t acc = 0;
+            for(unsigned int w = 0; w < words; w++)
+            {
+                acc ^= line[w] & x[w];
+            }
+            y[k / 64] |= (uint64_t)__builtin_parityll(acc) << (k % 64);
+        }
+    }
+
+    //  the sum of the lines selected by x
+    template<Layout L>
+    void multiplyLinesTransposed(const BitMatrix<L>& a, const uint64_t* x, uint64_t* y)
+    {
+        std::fill(y, y + a.getWords(), (uint64_t)0);
+        for(unsigned int k = 0; k < a.getLineCount(); k++)
+        {
+            if((x[k / 64] >> (k % 64)) & 1)
+            {
+                xorWords(y, a.getLine(k), a.getWords());
+            }
+        }
+    }
+
+    //  as for dense matrices, a column-packed A x sums the columns and
+    //  A^T x takes their parities
+    template<Layout L>
+    void multiply(const BitMatrix<L>& a, const uint64_t* x, uint64_t* y)
+    {
+        if constexpr(L == RowMajor)
+        {
+            multiplyLines(a, x, y);
+        }
+        else
+        {
+            multiplyLinesTransposed(a, x, y);
+        }
+    }
+
+    template<Layout L>
+    void multiplyTransposed(const BitMatrix<L>& a, const uint64_t* x, uint64_t* y)
+    {
+        if constexpr(L == RowMajor)
+        {
+            multiplyLinesTransposed(a, x, y);
+        }
+        else
+        {
+            multiplyLines(a, x, y);
+        }
+    }
+
+    template<typename M, typename T, unsigned int N, typename B, unsigned int K, typename C>
+    bool checkMultiply(const M& a, const Vector<T, N, B>& x, const Vector<T, K, C>& y, bool transposed)
+    {
+        unsigned int in = transposed ? a.getN() : a.getM();
+        unsigned int out = transposed ? a.getM() : a.getN();
+        if(x.getDim() != in || y.getDim() != out)
+        {
+            std::cout << "ERROR! Vectors of dimension (" << x.getDim() << "," << y.getDim()
+                      << ") are not compatible with matrix of size (" << a.getN() << "," << a.getM() << ")!" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    //  vector forms, y must have the dimension of the result
+    template<typename T, typename A, Layout L, unsigned int N, typename B, unsigned int K, typename C>
+    void multiply(const Matrix<T, A, L>& a, const Vector<T, N, B>& x, Vector<T, K, C>& y)
+    {
+        if(checkMultiply(a, x, y, false))
+        {
+            multiply(a, x.getData(), y.getData());
+        }
+    }
+
+    template<typename T, typename A, Layout L, unsigned int N, typename B, unsigned int K, typename C>
+    void multiplyTransposed(const Matrix<T, A, L>& a, const Vector<T, N, B>& x, Vector<T, K, C>& y)
+    {
+        if(checkMultiply(a, x, y, true))
+        {
+            multiplyTransposed(a, x.getData(), y.getData());
+        }
+    }
+
+    template<typename T, typename A, unsigned int N, typename B, unsigned int K, typename C>
+    void multiply(const SparseMatrix<T, A>& a, const Vector<T, N, B>& x, Vector<T, K, C>& y)
+    {
+        if(checkMultiply(a, x, y, false))
+        {
+            multiply(a, x.getData(), y.getData());
+        }
+    }
+
+    template<typename T, typename A, unsigned int N, typename B, unsigned int K, typename C>
+    void multiplyTransposed(const SparseMatrix<T, A>& a, const Vector<T, N, B>& x, Vector<T, K, C>& y)
+    {
+        if(checkMultiply(a, x, y, true))
+        {
+            multiplyTransposed(a, x.getData(), y.getData());
+        }
+    }
+
+    //  Z/2 vectors are packed into per-thread scratch words,
+    //  which only allocate when a larger chain first appears
+    template<unsigned int N, typename B>
+    void packChain(const Vector<Z2, N, B>& x, std::vector<uint64_t>& words)
+    {
+        words.assign((x.getDim() + 63) / 64, 0);
+        for(unsigned int i = 0; i < x.getDim(); i++)
+        {
+            words[i / 64] |= (uint64_t)x.get(i).getValue() << (i % 64);
+        }
+    }
+
+    template<unsigned int K, typename C>
+    void unpackChain(const std::vector<uint64_t>& words, Vector<Z2, K, C>& y)
+    {
+        for(unsigned int i = 0; i < y.getDim(); i++)
+        {
+            y(i) = Z2((int)((words[i / 64] >> (i % 64)) & 1));
+        }
+    }
+
+    template<Layout L, unsigned int N, typename B, unsigned int K, typename C>
+    void multiply(const BitMatrix<L>& a, const Vector<Z2, N, B>& x, Vector<Z2, K, C>& y)
+    {
+        if(!checkMultiply(a, x, y, false))
+        {
+            return;
+        }
+        static thread_local std::vector<uint64_t> in;
+        static thread_local std::vector<uint64_t> out;
+        packChain(x, in);
+        out.resize((a.getN() + 63) / 64);
+        multiply(a, in.data(), out.data());
+        unpackChain(out, y);
+    }
+
+    template<Layout L, unsigned int N, typename B, unsigned int K, typename C>
+    void multiplyTransposed(const BitMatrix<L>& a, const Vector<Z2, N, B>& x, Vector<Z2, K, C>& y)
+    {
+        if(!checkMultiply(a, x, y, true))
+        {
+            return;
+        }
+        static thread_local std::vector<uint64_t> in;
+        static thread_local std::vector<uint64_t> out;
+        packChain(x, in);
+        out.resize((a.getM() + 63) / 64);
+        multiplyTransposed(a, in.data(), out.data());
+        unpackChain(out, y);
+    }
+
+    //  A x as a new vector
+    template<typename T, typename A, Layout L, unsigned int N, typename B>
+    Vector<T> operator*(const Matrix<T, A, L>& a, const Vector<T, N, B>& x)
+    {
+        Vector<T> y(std::vector<T>(a.getN()));
+        multiply(a, x, y);
+        return y;
+    }
+
+    template<typename T, typename A, unsigned int N, typename B>
+    Vector<T> operator*(const SparseMatrix<T, A>& a, const Vector<T, N, B>& x)
+    {
+        Vector<T> y(std::vector<T>(a.getN()));
+        multiply(a, x, y);
+        return y;
+    }
+
+}
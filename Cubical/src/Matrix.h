@@ -3,43 +3,103 @@
 #include <string>
 #include <vector>
 #include <iostream>
+#include <utility>
+#include <memory>
+#include <type_traits>
+
+#include "Error.h"
+#include "Gemm.h"
+#include "Transpose.h"
+#include "Expression.h"
+#include "MatrixIO.h"
+#include "Stats.h"
+#include "View.h"
 
 namespace Cubical
 {
     //  array typedef
-    template<typename T>
-    using array = std::vector<std::vector<T> >;
+    template<typename U>
+    using array = std::vector<std::vector<U> >;
     
-    template<typename T>
-    class Matrix
+    //  Dense matrix in row-major or column-major layout. The interface is
+    //  the same for both, the layout only decides which elementary
+    //  operations are contiguous: row operations in row-major and column
+    //  operations in column-major storage, while exchanges of rows or of
+    //  columns respectively only swap two indices.
+    template<typename T, typename Alloc, Layout L>
+    class Matrix : public MatrixExpression<Matrix<T, Alloc, L> >
     {
         public:
-            Matrix<T>();
-            virtual ~Matrix<T>();
-            Matrix<T>(unsigned int n, unsigned int m);
-            Matrix<T>(array<T> mat);
-            Matrix<T>(const std::string& filename);
+            typedef T value_type;
+            typedef typename MatrixView<const T, L>::Row Row;
+            //  the layout holding the transpose in the same storage
+            static const Layout Transposed = L == RowMajor ? ColumnMajor : RowMajor;
+
+            Matrix<T, Alloc, L>();
+            virtual ~Matrix<T, Alloc, L>();
+            Matrix<T, Alloc, L>(const Matrix<T, Alloc, L>& other) = default;
+            Matrix<T, Alloc, L>& operator=(const Matrix<T, Alloc, L>& other) = default;
+            //  takes the storage, other is left an empty 0 x 0 matrix
+            Matrix<T, Alloc, L>(Matrix<T, Alloc, L>&& other) noexcept;
+            Matrix<T, Alloc, L>& operator=(Matrix<T, Alloc, L>&& other) noexcept;
+            Matrix<T, Alloc, L>(unsigned int n, unsigned int m, const Alloc& alloc = Alloc());
+            Matrix<T, Alloc, L>(array<T> mat);
+            //  loads a binary matrix file or a text matrix, one row per line
+            //  with entries separated by whitespace or commas
+            Matrix<T, Alloc, L>(const std::string& filename);
+            //  the same matrix in the other layout, transposing the storage
+            template<Layout K, typename = typename std::enable_if<K != L>::type>
+            explicit Matrix<T, Alloc, L>(const Matrix<T, Alloc, K>& other, unsigned int threads = 1);
+            //  evaluates an expression such as a + b * 2 - c in one pass
+            template<typename E>
+            Matrix<T, Alloc, L>(const MatrixExpression<E>& expression);
+            template<typename E>
+            Matrix<T, Alloc, L>& operator=(const MatrixExpression<E>& expression);
 
             //  getters and setters
             unsigned int getN() const { return m_N; }
             unsigned int getM() const { return m_M; }
-            array<T> getMat() const { return m_Mat; }
+            static Layout getLayout() { return L; }
+            array<T> getMat() const;
+            //  unchecked access used by expressions
+            Row getRow(unsigned int i) const { return getView().getRow(i); }
+            T get(unsigned int i, unsigned int j) const { return at(i, j); }
+            bool isValid() const { return true; }
+            Alloc getAllocator() const { return m_Data.get_allocator(); }
+            //  views of the entries without copying, valid until resized
+            MatrixView<const T, L> getView() const { return MatrixView<const T, L>(m_Data.data(), m_Lines.data(), m_N, m_M); }
+            MatrixView<T, L> getView() { return MatrixView<T, L>(m_Data.data(), m_Lines.data(), m_N, m_M); }
+            //  the transpose as a view of the same storage in the other
+            //  layout, it must not appear in an expression assigned to
+            //  this matrix
+            MatrixView<const T, Transposed> getTransposedView() const
+            {
+                return MatrixView<const T, Transposed>(m_Data.data(), m_Lines.data(), m_M, m_N);
+            }
+            MatrixView<T, Transposed> getTransposedView()
+            {
+                return MatrixView<T, Transposed>(m_Data.data(), m_Lines.data(), m_M, m_N);
+            }
 
-            //  operator overloads
+            //  operator overloads, bounds checked in CUBICAL_CHECKED builds
             T operator()(unsigned int i, unsigned int j) const;
             T& operator()(unsigned int i, unsigned int j);
-            //  addition
-            Matrix<T> operator+(const Matrix<T>& other) const;
-            void operator+=(const Matrix<T>& other);
-            //  substraction
-            Matrix<T> operator-(const Matrix<T>& other) const;
-            void operator-=(const Matrix<T>& other);
+            //  addition and subtraction, a + b and a - b are expressions
+            template<typename E>
+            void operator+=(const MatrixExpression<E>& other);
+            template<typename E>
+            void operator-=(const MatrixExpression<E>& other);
             //  multiplication
-            Matrix<T> operator*(const Matrix<T>& other) const;
-            void operator*=(const Matrix<T>& other);
-            //  scalar multiplication
-            Matrix<T> operator*(const T scalar) const;
+            Matrix<T, Alloc, L> operator*(const Matrix<T, Alloc, L>& other) const;
+            void operator*=(const Matrix<T, Alloc, L>& other);
+            //  this = a * b reusing this matrix's storage, either operand may
+            //  be this matrix
+            void multiply(const Matrix<T, Alloc, L>& a, const Matrix<T, Alloc, L>& b, unsigned int threads = 1);
+            //  scalar multiplication, a * scalar is an expression
             void operator*=(const T scalar);
+            //  transposes in place, without allocating if the matrix is
+            //  square and no lines have been exchanged
+            void transpose(unsigned int threads = 1);
 
             //  basic linear algebra
             void rowExchange(unsigned int i, unsigned int j);
@@ -51,352 +111,573 @@ namespace Cubical
             void columnAdd(unsigned int i, unsigned int j, const T value);
 
             void print();
+            //  writes a dense binary matrix file
+            bool save(const std::string& filename) const;
 
         private:
             //  size
             unsigned int m_N;
             unsigned int m_M;
-            //  array
-            array<T> m_Mat;
-            
+            //  contiguous storage of m_N * m_M entries, rows after each
+            //  other in row-major and columns in column-major layout
+            std::vector<T, Alloc> m_Data;
+            //  physical line of each logical row in row-major or column
+            //  in column-major layout, so that exchanges swap two indices
+            std::vector<unsigned int> m_Lines;
+
+            //  evaluates an expression of matching size into this
+            template<typename E>
+            void assign(const E& expression);
+            //  resize to n x m zeros with the identity line permutation
+            void reshape(unsigned int n, unsigned int m);
+            void multiplyInto(const Matrix<T, Alloc, L>& a, const Matrix<T, Alloc, L>& b, unsigned int threads);
+            //  number and length of the lines
+            unsigned int getLineCount() const { return L == RowMajor ? m_N : m_M; }
+            unsigned int getLineLength() const { return L == RowMajor ? m_M : m_N; }
+            //  start of logical line k in m_Data
+            T* line(unsigned int k) { return m_Data.data() + (size_t)m_Lines[k] * getLineLength(); }
+            const T* line(unsigned int k) const { return m_Data.data() + (size_t)m_Lines[k] * getLineLength(); }
+            T& at(unsigned int i, unsigned int j) { return L == RowMajor ? line(i)[j] : line(j)[i]; }
+            const T& at(unsigned int i, unsigned int j) const { return L == RowMajor ? line(i)[j] : line(j)[i]; }
+            //  operations on lines i and j, rows in row-major layout
+            void lineExchange(unsigned int i, unsigned int j);
+            void lineMultiply(unsigned int i, const T value);
+            void lineAdd(unsigned int i, unsigned int j, const T value);
+            //  operations on entries i and j of every line, walking the
+            //  storage in order
+            void crossExchange(unsigned int i, unsigned int j);
+            void crossMultiply(unsigned int i, const T value);
+            void crossAdd(unsigned int i, unsigned int j, const T value);
+
+            template<typename, typename, Layout>
+            friend class Matrix;
     };
+    //  y += a x over n entries, the kernel of row additions. Scalar
+    //  types may overload it with a vectorized version, as ModP does.
     template<typename T>
-    Matrix<T> rowExchange(const Matrix<T>& other, unsigned int i, unsigned int j)
+    void addScaled(T* y, const T* x, const T a, size_t n)
     {
-        array<T> temp = other.getMat();
-        if( i >= other.getN() || j >= other.getN())
+        for(size_t k = 0; k < n; k++)
         {
-            std::cout << "ERROR! Rows (" << i << "," << j << ") exceed matrix of size (" << other.getN() << "," << other.getM() << ")!" << std::endl;
+            y[k] += a * x[k];
         }
-        else
+    }
+
+    //  Out-of-place elementary operations. A const matrix is copied once
+    //  and the operation applied in place to the copy, a temporary or
+    //  moved matrix is modified and returned without copying.
+    template<typename T, typename Alloc, Layout L>
+    Matrix<T, Alloc, L> rowExchange(const Matrix<T, Alloc, L>& other, unsigned int i, unsigned int j)
+    {
+        Matrix<T, Alloc, L> temp(other);
+        temp.rowExchange(i, j);
+        return temp;
+    }
+
+    template<typename T, typename Alloc, Layout L>
+    Matrix<T, Alloc, L> rowExchange(Matrix<T, Alloc, L>&& other, unsigned int i, unsigned int j)
+    {
+        other.rowExchange(i, j);
+        return std::move(other);
+    }
+
+    template<typename T, typename Alloc, Layout L>
+    Matrix<T, Alloc, L> rowMultiply(const Matrix<T, Alloc, L>& other, unsigned int i, const T value)
+    {
+        Matrix<T, Alloc, L> temp(other);
+        temp.rowMultiply(i, value);
+        return temp;
+    }
+
+    template<typename T, typename Alloc, Layout L>
+    Matrix<T, Alloc, L> rowMultiply(Matrix<T, Alloc, L>&& other, unsigned int i, const T value)
+    {
+        other.rowMultiply(i, value);
+        return std::move(other);
+    }
+
+    template<typename T, typename Alloc, Layout L>
+    Matrix<T, Alloc, L> rowAdd(const Matrix<T, Alloc, L>& other, unsigned int i, unsigned int j, const T value)
+    {
+        Matrix<T, Alloc, L> temp(other);
+        temp.rowAdd(i, j, value);
+        return temp;
+    }
+
+    template<typename T, typename Alloc, Layout L>
+    Matrix<T, Alloc, L> rowAdd(Matrix<T, Alloc, L>&& other, unsigned int i, unsigned int j, const T value)
+    {
+        other.rowAdd(i, j, value);
+        return std::move(other);
+    }
+
+    template<typename T, typename Alloc, Layout L>
+    Matrix<T, Alloc, L> columnExchange(const Matrix<T, Alloc, L>& other, unsigned int i, unsigned int j)
+    {
+        Matrix<T, Alloc, L> temp(other);
+        temp.columnExchange(i, j);
+        return temp;
+    }
+
+    template<typename T, typename Alloc, Layout L>
+    Matrix<T, Alloc, L> columnExchange(Matrix<T, Alloc, L>&& other, unsigned int i, unsigned int j)
+    {
+        other.columnExchange(i, j);
+        return std::move(other);
+    }
+
+    template<typename T, typename Alloc, Layout L>
+    Matrix<T, Alloc, L> columnMultiply(const Matrix<T, Alloc, L>& other, unsigned int i, const T value)
+    {
+        Matrix<T, Alloc, L> temp(other);
+        temp.columnMultiply(i, value);
+        return temp;
+    }
+
+    template<typename T, typename Alloc, Layout L>
+    Matrix<T, Alloc, L> columnMultiply(Matrix<T, Alloc, L>&& other, unsigned int i, const T value)
+    {
+        other.columnMultiply(i, value);
+        return std::move(other);
+    }
+
+    template<typename T, typename Alloc, Layout L>
+    Matrix<T, Alloc, L> columnAdd(const Matrix<T, Alloc, L>& other, unsigned int i, unsigned int j, const T value)
+    {
+        Matrix<T, Alloc, L> temp(other);
+        temp.columnAdd(i, j, value);
+        return temp;
+    }
+
+    template<typename T, typename Alloc, Layout L>
+    Matrix<T, Alloc, L> columnAdd(Matrix<T, Alloc, L>&& other, unsigned int i, unsigned int j, const T value)
+    {
+        other.columnAdd(i, j, value);
+        return std::move(other);
+    }
+
+    template<typename T, typename Alloc, Layout L>
+    Matrix<T, Alloc, L> transpose(const Matrix<T, Alloc, L>& other, unsigned int threads = 1)
+    {
+        Matrix<T, Alloc, L> temp(other);
+        temp.transpose(threads);
+        return temp;
+    }
+
+    template<typename T, typename Alloc, Layout L>
+    Matrix<T, Alloc, L> transpose(Matrix<T, Alloc, L>&& other, unsigned int threads = 1)
+    {
+        other.transpose(threads);
+        return std::move(other);
+    }
+
+
+    template<typename T, typename Alloc, Layout L>
+    Matrix<T, Alloc, L>::Matrix() : m_N(0), m_M(0)
+    {
+
+    }
+
+    template<typename T, typename Alloc, Layout L>
+    Matrix<T, Alloc, L>::~Matrix()
+    {
+
+    }
+
+    template<typename T, typename Alloc, Layout L>
+    Matrix<T, Alloc, L>::Matrix(Matrix<T, Alloc, L>&& other) noexcept
+    : m_N(other.m_N), m_M(other.m_M), m_Data(std::move(other.m_Data)), m_Lines(std::move(other.m_Lines))
+    {
+        other.m_N = 0;
+        other.m_M = 0;
+        other.m_Data.clear();
+        other.m_Lines.clear();
+    }
+
+    template<typename T, typename Alloc, Layout L>
+    Matrix<T, Alloc, L>& Matrix<T, Alloc, L>::operator=(Matrix<T, Alloc, L>&& other) noexcept
+    {
+        if(this != &other)
+        {
+            m_N = other.m_N;
+            m_M = other.m_M;
+            m_Data = std::move(other.m_Data);
+            m_Lines = std::move(other.m_Lines);
+            other.m_N = 0;
+            other.m_M = 0;
+            other.m_Data.clear();
+            other.m_Lines.clear();
+        }
+        return *this;
+    }
+
+    template<typename T, typename Alloc, Layout L>
+    Matrix<T, Alloc, L>::Matrix(unsigned int n, unsigned int m, const Alloc& alloc)
+    : m_N(n), m_M(m), m_Data((size_t)n * m, T(), alloc), m_Lines(getLineCount())
+    {
+        for(unsigned int k = 0; k < m_Lines.size(); k++)
         {
-            temp[i] = other.getMat()[j];
-            temp[j] = other.getMat()[i];
+            m_Lines[k] = k;
         }
-        return Matrix<T>(temp);
     }
-    template<typename T>
-    Matrix<T> rowMultiply(const Matrix<T>& other, unsigned int i, const T value)
+
+    template<typename T, typename Alloc, Layout L>
+    Matrix<T, Alloc, L>::Matrix(array<T> mat)
     {
-        array<T> temp = other.getMat();
-        if( i >= other.getN())
+        if constexpr(L == ColumnMajor)
         {
-            std::cout << "ERROR! Row " << i << " exceed matrix of size (" << other.getN() << "," << other.getM() << ")!" << std::endl;
+            *this = Matrix<T, Alloc, L>(Matrix<T, Alloc, RowMajor>(mat));
+            return;
         }
-        else
+        m_N = mat.size();
+        m_M = m_N > 0 ? mat[0].size() : 0;
+        m_Data.reserve((size_t)m_N * m_M);
+        m_Lines.resize(m_N);
+        for(unsigned int i = 0; i < m_N; i++)
         {
-            for(unsigned int j = 0; j < other.getM(); j++)
-            {
-                temp[i][j] *= value;
-            }
+            m_Data.insert(m_Data.end(), mat[i].begin(), mat[i].begin() + m_M);
+            m_Lines[i] = i;
         }
-        return Matrix<T>(temp);
     }
-    template<typename T>
-    Matrix<T> rowAdd(const Matrix<T>& other, unsigned int i, unsigned int j, const T value)
+
+    template<typename T, typename Alloc, Layout L>
+    Matrix<T, Alloc, L>::Matrix(const std::string& filename) : m_N(0), m_M(0)
     {
-        array<T> temp = other.getMat();
-        if( i >= other.getN() || j >= other.getN())
+        if constexpr(L == ColumnMajor)
         {
-            std::cout << "ERROR! Rows (" << i << "," << j << ") exceed matrix of size (" << other.getN() << "," << other.getM() << ")!" << std::endl;
+            //  files hold rows, so they are read row-major and transposed once
+            *this = Matrix<T, Alloc, L>(Matrix<T, Alloc, RowMajor>(filename));
+            return;
         }
-        else
+        MappedFile file(filename);
+        if(!file.isOpen())
+        {
+            std::cout << "ERROR! Could not open " << filename << "!" << std::endl;
+            return;
+        }
+        if(!isMatrixFile(file.getData(), file.getSize()))
         {
-            for(unsigned int k = 0; k < other.getM(); k++)
+            unsigned int n = 0;
+            unsigned int m = 0;
+            if(parseMatrixText(file.getData(), file.getData() + file.getSize(), n, m, m_Data))
+            {
+                m_N = n;
+                m_M = m;
+                m_Lines.resize(m_N);
+                for(unsigned int i = 0; i < m_N; i++)
+                {
+                    m_Lines[i] = i;
+                }
+            }
+            else
             {
-                temp[i][k] += value * other.getMat()[j][k];
+                m_Data.clear();
             }
+            return;
         }
-        return Matrix<T>(temp);
-    }
-    
-    template<typename T>
-    Matrix<T> columnExchange(const Matrix<T>& other, unsigned int i, unsigned int j)
-    {
-        array<T> temp = other.getMat();
-        if( i >= other.getM() || j >= other.getM())
+        //  the mapping is the only read of the file, the values are copied once
+        MappedMatrix<T> mapped(std::move(file));
+        if(!mapped.isValid())
         {
-            std::cout << "ERROR! columns (" << i << "," << j << ") exceed matrix of size (" << other.getN() << "," << other.getM() << ")!" << std::endl;
+            return;
         }
-        else
+        reshape(mapped.getN(), mapped.getM());
+        if(!mapped.isSparse())
+        {
+            std::copy(mapped.getData(), mapped.getData() + m_Data.size(), m_Data.begin());
+            return;
+        }
+        const uint64_t* offsets = mapped.getColumnOffsets();
+        for(unsigned int j = 0; j < m_M; j++)
         {
-            for(unsigned int k = 0; k < other.getN(); k++)
+            for(uint64_t k = offsets[j]; k < offsets[j + 1]; k++)
             {
-                temp[k][i] = other.getMat()[k][j];
-                temp[k][j] = other.getMat()[k][i];
+                unsigned int i = mapped.getRowIndices()[k];
+                if(i >= m_N)
+                {
+                    std::cout << "ERROR! Row " << i << " of column " << j << " exceeds matrix of size (" << m_N << "," << m_M << ")!" << std::endl;
+                    continue;
+                }
+                at(i, j) = mapped.getValues()[k];
             }
         }
-        return Matrix<T>(temp);
     }
 
-    template<typename T>
-    Matrix<T> columnMultiply(const Matrix<T>& other, unsigned int i, const T value)
+    template<typename T, typename Alloc, Layout L>
+    template<Layout K, typename>
+    Matrix<T, Alloc, L>::Matrix(const Matrix<T, Alloc, K>& other, unsigned int threads)
+    : m_N(other.m_N), m_M(other.m_M), m_Data((size_t)other.m_N * other.m_M, T(), other.getAllocator()),
+      m_Lines(getLineCount())
     {
-        array<T> temp = other.getMat();
-        if(i >= other.getM())
+        //  the lines of other are the cross sections of this matrix
+        std::vector<const T*> lines(other.getLineCount());
+        for(unsigned int k = 0; k < lines.size(); k++)
         {
-            std::cout << "ERROR! column " << i << " exceed matrix of size (" << other.getN() << "," << other.getM() << ")!" << std::endl;
+            lines[k] = other.line(k);
         }
-        else
+        transposeInto(other.getLineCount(), other.getLineLength(), lines.data(), m_Data.data(), threads);
+        for(unsigned int k = 0; k < m_Lines.size(); k++)
         {
-            for(unsigned int j = 0; j < other.getN(); j++)
-            {
-                temp[j][i] *= value;
-            }
+            m_Lines[k] = k;
         }
-        return Matrix<T>(temp);
     }
 
-    template<typename T>
-    Matrix<T> columnAdd(const Matrix<T>& other, unsigned int i, unsigned int j, const T value)
+    template<typename T, typename Alloc, Layout L>
+    array<T> Matrix<T, Alloc, L>::getMat() const
     {
-        array<T> temp = other.getMat();
-        if( i >= other.getM() || j >= other.getM())
-        {
-            std::cout << "ERROR! columns (" << i << "," << j << ") exceed matrix of size (" << other.getN() << "," << other.getM() << ")!" << std::endl;
-        }
-        else
+        array<T> temp(m_N, std::vector<T>(m_M));
+        for(unsigned int i = 0; i < m_N; i++)
         {
-            for(unsigned int k = 0; k < other.getN(); k++)
+            for(unsigned int j = 0; j < m_M; j++)
             {
-                temp[k][i] += value * other.getMat()[k][j];
+                temp[i][j] = at(i, j);
             }
         }
-        return Matrix<T>(temp);
+        return temp;
     }
 
-
-    template<typename T>
-    Matrix<T>::Matrix() : m_N(0), m_M(0)
+    template<typename T, typename Alloc, Layout L>
+    T Matrix<T, Alloc, L>::operator()(unsigned int i, unsigned int j) const
     {
-
+#ifdef CUBICAL_CHECKED
+        if(i >= m_N || j >= m_M)
+        {
+            throwIndexError(i, j, m_N, m_M);
+        }
+#endif
+        return at(i, j);
     }
 
-    template<typename T>
-    Matrix<T>::~Matrix()
+    template<typename T, typename Alloc, Layout L>
+    T& Matrix<T, Alloc, L>::operator()(unsigned int i, unsigned int j)
     {
-
+#ifdef CUBICAL_CHECKED
+        if(i >= m_N || j >= m_M)
+        {
+            throwIndexError(i, j, m_N, m_M);
+        }
+#endif
+        return at(i, j);
     }
-
-    template<typename T>
-    Matrix<T>::Matrix(unsigned int n, unsigned int m) : m_N(n), m_M(m)
+    
+    template<typename T, typename Alloc, Layout L>
+    template<typename E>
+    Matrix<T, Alloc, L>::Matrix(const MatrixExpression<E>& expression) : m_N(0), m_M(0)
     {
-
+        *this = expression;
     }
 
-    template<typename T>
-    Matrix<T>::Matrix(array<T> mat) : m_Mat(std::move(mat))
+    template<typename T, typename Alloc, Layout L>
+    template<typename E>
+    Matrix<T, Alloc, L>& Matrix<T, Alloc, L>::operator=(const MatrixExpression<E>& expression)
     {
-        m_N = m_Mat.size();
-        m_M = m_Mat[0].size();
+        const E& e = expression.self();
+        if(!e.isValid())
+        {
+            //  incompatible operands, evaluate element by element
+            //  into a copy since this may appear in the expression
+            Matrix<T, Alloc, L> temp(e.getN(), e.getM(), getAllocator());
+            for(unsigned int i = 0; i < e.getN(); i++)
+            {
+                for(unsigned int j = 0; j < e.getM(); j++)
+                {
+                    temp.at(i, j) = e.get(i,j);
+                }
+            }
+            m_N = temp.m_N;
+            m_M = temp.m_M;
+            m_Data.swap(temp.m_Data);
+            m_Lines.swap(temp.m_Lines);
+            return *this;
+        }
+        if(m_N != e.getN() || m_M != e.getM())
+        {
+            reshape(e.getN(), e.getM());
+        }
+        //  element-wise, so evaluating in place is safe even if this
+        //  is an operand
+        assign(e);
+        return *this;
     }
 
-    template<typename T>
-    Matrix<T>::Matrix(const std::string& filename)
+    template<typename T, typename Alloc, Layout L>
+    template<typename E>
+    void Matrix<T, Alloc, L>::assign(const E& expression)
     {
-
+        for(unsigned int i = 0; i < m_N; i++)
+        {
+            typename E::Row source = expression.getRow(i);
+            if constexpr(L == RowMajor)
+            {
+                T* a = line(i);
+                for(unsigned int j = 0; j < m_M; j++)
+                {
+                    a[j] = source[j];
+                }
+            }
+            else
+            {
+                for(unsigned int j = 0; j < m_M; j++)
+                {
+                    line(j)[i] = source[j];
+                }
+            }
+        }
     }
 
-    template<typename T>
-    T Matrix<T>::operator()(unsigned int i, unsigned int j) const
+    template<typename T, typename Alloc, Layout L>
+    template<typename E>
+    void Matrix<T, Alloc, L>::operator+=(const MatrixExpression<E>& other)
     {
-        if(i >= m_N || j >= m_M)
-        {
-            std::cout << "ERROR! Indices (" << i << "," << j 
-                      << ") exceeds matrix of size (" << m_N << "," << m_M << ")!" << std::endl;
-            return m_Mat[0][0];
-        }
-        return m_Mat[i][j];
+        *this = *this + other;
     }
 
-    template<typename T>
-    T& Matrix<T>::operator()(unsigned int i, unsigned int j)
+    template<typename T, typename Alloc, Layout L>
+    template<typename E>
+    void Matrix<T, Alloc, L>::operator-=(const MatrixExpression<E>& other)
     {
-        if(i >= m_N || j >= m_M)
-        {
-            std::cout << "ERROR! Indices (" << i << "," << j 
-                      << ") exceeds matrix of size (" << m_N << "," << m_M << ")!" << std::endl;
-            return m_Mat[0][0];
-        }
-        return m_Mat[i][j];
+        *this = *this - other;
     }
-    
-    template<typename T>
-    Matrix<T> Matrix<T>::operator+(const Matrix<T>& other) const
+
+    template<typename T, typename Alloc, Layout L>
+    Matrix<T, Alloc, L> Matrix<T, Alloc, L>::operator*(const Matrix<T, Alloc, L>& other) const
     {
-        array<T> temp;
-        if((m_N != other.getN()) || (m_M != other.getM()))
+        if(m_M != other.getN())
         {
             std::cout << "ERROR! Matrices are not compatible!" << std::endl;
-            temp = m_Mat;
-        }
-        else
-        {
-           for(unsigned int i = 0; i < m_N; i++)
-           {
-               std::vector<T> tempRow;
-               for(unsigned int j = 0; j < m_M; j++)
-               {
-                   tempRow.push_back(m_Mat[i][j] + other(i,j));
-               }
-               temp.push_back(tempRow);
-           }
+            return *this;
         }
-        return Matrix<T>(temp);
+        Matrix<T, Alloc, L> temp(0, 0, getAllocator());
+        temp.multiply(*this, other);
+        return temp;
     }
 
-    template<typename T>
-    void Matrix<T>::operator+=(const Matrix<T>& other)
+    template<typename T, typename Alloc, Layout L>
+    void Matrix<T, Alloc, L>::operator*=(const Matrix<T, Alloc, L>& other)
+    {
+        multiply(*this, other);
+    }
+
+    template<typename T, typename Alloc, Layout L>
+    void Matrix<T, Alloc, L>::multiply(const Matrix<T, Alloc, L>& a, const Matrix<T, Alloc, L>& b, unsigned int threads)
     {
-        if((m_N != other.getN()) || (m_M != other.getM()))
+        if(a.getM() != b.getN())
         {
             std::cout << "ERROR! Matrices are not compatible!" << std::endl;
             return;
         }
-        else
+        if(&a != this && &b != this)
         {
-           for(unsigned int i = 0; i < m_N; i++)
-           {
-               for(unsigned int j = 0; j < m_M; j++)
-               {
-                   m_Mat[i][j] += other(i,j);
-               }
-           }
+            multiplyInto(a, b, threads);
+            return;
+        }
+        //  An operand is this matrix, so the product goes to a per-thread
+        //  scratch matrix whose buffer is then swapped with ours, and
+        //  repeated calls do not allocate. Buffers from another allocator
+        //  are copied back instead, so the scratch never holds memory of an
+        //  arena that may be released.
+        static thread_local Matrix<T, Alloc, L> scratch;
+        scratch.multiplyInto(a, b, threads);
+        if(std::is_same<Alloc, std::allocator<T> >::value)
+        {
+            std::swap(m_N, scratch.m_N);
+            std::swap(m_M, scratch.m_M);
+            m_Data.swap(scratch.m_Data);
+            m_Lines.swap(scratch.m_Lines);
+            return;
         }
+        m_N = scratch.m_N;
+        m_M = scratch.m_M;
+        m_Data.assign(scratch.m_Data.begin(), scratch.m_Data.end());
+        m_Lines.assign(scratch.m_Lines.begin(), scratch.m_Lines.end());
     }
 
-    template<typename T>
-    Matrix<T> Matrix<T>::operator-(const Matrix<T>& other) const
+    //  a and b must not be this matrix, as reshape clears it
+    template<typename T, typename Alloc, Layout L>
+    void Matrix<T, Alloc, L>::multiplyInto(const Matrix<T, Alloc, L>& a, const Matrix<T, Alloc, L>& b, unsigned int threads)
     {
-        array<T> temp;
-        if((m_N != other.getN()) || (m_M != other.getM()))
+        CUBICAL_STATS_ADD(matrixMultiplies, 1);
+        CUBICAL_STATS_SCOPE("matrix multiply", -1);
+        reshape(a.getN(), b.getM());
+        //  line pointers are per-thread scratch, so products allocate
+        //  nothing once the sizes have been seen
+        static thread_local std::vector<const T*> aLines;
+        static thread_local std::vector<const T*> bLines;
+        aLines.resize(a.getLineCount());
+        bLines.resize(b.getLineCount());
+        for(unsigned int k = 0; k < aLines.size(); k++)
         {
-            std::cout << "ERROR! Matrices are not compatible!" << std::endl;
-            temp = m_Mat;
+            aLines[k] = a.line(k);
         }
-        else
+        for(unsigned int k = 0; k < bLines.size(); k++)
         {
-           for(unsigned int i = 0; i < m_N; i++)
-           {
-               std::vector<T> tempRow;
-               for(unsigned int j = 0; j < m_M; j++)
-               {
-                   tempRow.push_back(m_Mat[i][j] - other(i,j));
-               }
-               temp.push_back(tempRow);
-           }
+            bLines[k] = b.line(k);
         }
-        return Matrix<T>(temp);
-    }
-
-    template<typename T>
-    void Matrix<T>::operator-=(const Matrix<T>& other)
-    {
-        if((m_N != other.getN()) || (m_M != other.getM()))
+        if constexpr(L == RowMajor)
         {
-            std::cout << "ERROR! Matrices are not compatible!" << std::endl;
-            return;
+            gemm(m_N, a.getM(), m_M, aLines.data(), bLines.data(), m_Data.data(), threads);
         }
         else
         {
-           for(unsigned int i = 0; i < m_N; i++)
-           {
-               for(unsigned int j = 0; j < m_M; j++)
-               {
-                   m_Mat[i][j] -= other(i,j);
-               }
-           }
+            //  column-major storage holds the transpose, and (ab)^T = b^T a^T
+            gemm(m_M, a.getM(), m_N, bLines.data(), aLines.data(), m_Data.data(), threads);
         }
     }
 
-    template<typename T>
-    Matrix<T> Matrix<T>::operator*(const Matrix<T>& other) const
+    template<typename T, typename Alloc, Layout L>
+    void Matrix<T, Alloc, L>::reshape(unsigned int n, unsigned int m)
     {
-        array<T> temp;
-        if(m_M != other.getN())
+        m_N = n;
+        m_M = m;
+        m_Data.assign((size_t)n * m, T());
+        m_Lines.resize(getLineCount());
+        for(unsigned int k = 0; k < m_Lines.size(); k++)
         {
-            std::cout << "ERROR! Matrices are not compatible!" << std::endl;
-            temp = m_Mat;
+            m_Lines[k] = k;
         }
-        else
+    }
+
+    template<typename T, typename Alloc, Layout L>
+    void Matrix<T, Alloc, L>::operator*=(const T scalar)
+    {
+        for(size_t k = 0; k < m_Data.size(); k++)
         {
-           for(unsigned int i = 0; i < m_N; i++)
-           {
-               std::vector<T> tempRow;
-               for(unsigned int j = 0; j < other.getM(); j++)
-               {
-                   T tempVal = 0.0;
-                   for(unsigned int k = 0; k < m_M; k++)
-                   {
-                       tempVal += m_Mat[i][k]*other(k,j);
-                   }
-                   tempRow.push_back(tempVal);
-               }
-               temp.push_back(tempRow);
-           }
+            m_Data[k] *= scalar;
         }
-        return Matrix<T>(temp);
     }
 
-    template<typename T>
-    void Matrix<T>::operator*=(const Matrix<T>& other)
+    template<typename T, typename Alloc, Layout L>
+    void Matrix<T, Alloc, L>::transpose(unsigned int threads)
     {
-        array<T> temp;
-        if(m_M != other.getN())
+        CUBICAL_STATS_SCOPE("matrix transpose", -1);
+        bool identity = true;
+        for(unsigned int k = 0; k < m_Lines.size() && identity; k++)
         {
-            std::cout << "ERROR! Matrices are not compatible!" << std::endl;
-            return;
+            identity = m_Lines[k] == k;
         }
-        else
+        if(m_N == m_M && identity)
         {
-           for(unsigned int i = 0; i < m_N; i++)
-           {
-               std::vector<T> tempRow;
-               for(unsigned int j = 0; j < other.getM(); j++)
-               {
-                   T tempVal = 0.0;
-                   for(unsigned int k = 0; k < m_M; k++)
-                   {
-                       tempVal += m_Mat[i][k]*other(k,j);
-                   }
-                   tempRow.push_back(tempVal);
-               }
-               temp.push_back(tempRow);
-           }
+            transposeSquare(m_Data.data(), m_N, threads);
+            return;
         }
-        m_Mat = temp;
-    }
-
-    template<typename T>
-    Matrix<T> Matrix<T>::operator*(const T scalar) const
-    {
-        array<T> temp;
-        for(unsigned int i = 0; i < m_N; i++)
+        std::vector<const T*> lines(getLineCount());
+        for(unsigned int k = 0; k < lines.size(); k++)
         {
-            std::vector<T> tempRow;
-            for(unsigned int j = 0; j < m_M; j++)
-            {
-                tempRow.push_back(m_Mat[i][j]*scalar);
-            }
-            temp.push_back(tempRow);
+            lines[k] = line(k);
         }
-        return Matrix<T>(temp);
-    }
-
-    template<typename T>
-    void Matrix<T>::operator*=(const T scalar)
-    {
-        for(unsigned int i = 0; i < m_N; i++)
+        std::vector<T, Alloc> temp(m_Data.size(), T(), getAllocator());
+        transposeInto(getLineCount(), getLineLength(), lines.data(), temp.data(), threads);
+        m_Data.swap(temp);
+        std::swap(m_N, m_M);
+        m_Lines.resize(getLineCount());
+        for(unsigned int k = 0; k < m_Lines.size(); k++)
         {
-            for(unsigned int j = 0; j < m_M; j++)
-            {
-                m_Mat[i][j] *= scalar;
-            }
+            m_Lines[k] = k;
         }
     }
 
-    template<typename T>
-    void Matrix<T>::rowExchange(unsigned int i, unsigned int j)
+    template<typename T, typename Alloc, Layout L>
+    void Matrix<T, Alloc, L>::rowExchange(unsigned int i, unsigned int j)
     {
         if( i >= m_N || j >= m_N)
         {
@@ -405,14 +686,20 @@ namespace Cubical
         }
         else
         {
-            std::vector<T> temp = m_Mat[j];
-            m_Mat[j] = m_Mat[i];
-            m_Mat[i] = temp;
+            CUBICAL_STATS_ADD(elementaryOperations, 1);
+            if(L == RowMajor)
+            {
+                lineExchange(i, j);
+            }
+            else
+            {
+                crossExchange(i, j);
+            }
         }
     }
 
-    template<typename T>
-    void Matrix<T>::rowMultiply(unsigned int i, const T value)
+    template<typename T, typename Alloc, Layout L>
+    void Matrix<T, Alloc, L>::rowMultiply(unsigned int i, const T value)
     {
         if( i >= m_N)
         {
@@ -421,17 +708,20 @@ namespace Cubical
         }
         else
         {
-            for(unsigned int j = 0; j < m_M; j++)
+            CUBICAL_STATS_ADD(elementaryOperations, 1);
+            if(L == RowMajor)
+            {
+                lineMultiply(i, value);
+            }
+            else
             {
-                m_Mat[i][j] *= value;
+                crossMultiply(i, value);
             }
         }
     }
 
-    
-
-    template<typename T>
-    void Matrix<T>::rowAdd(unsigned int i, unsigned int j, const T value)
+    template<typename T, typename Alloc, Layout L>
+    void Matrix<T, Alloc, L>::rowAdd(unsigned int i, unsigned int j, const T value)
     {
         if( i >= m_N || j >= m_N)
         {
@@ -440,15 +730,20 @@ namespace Cubical
         }
         else
         {
-            for(unsigned int k = 0; k < m_M; k++)
+            CUBICAL_STATS_ADD(elementaryOperations, 1);
+            if(L == RowMajor)
+            {
+                lineAdd(i, j, value);
+            }
+            else
             {
-                m_Mat[i][k] += value * m_Mat[j][k];
+                crossAdd(i, j, value);
             }
         }
     }
 
-    template<typename T>
-    void Matrix<T>::columnExchange(unsigned int i, unsigned int j)
+    template<typename T, typename Alloc, Layout L>
+    void Matrix<T, Alloc, L>::columnExchange(unsigned int i, unsigned int j)
     {
         if( i >= m_M || j >= m_M)
         {
@@ -457,17 +752,20 @@ namespace Cubical
         }
         else
         {
-            for(unsigned int k = 0; k < m_N; k++)
+            CUBICAL_STATS_ADD(elementaryOperations, 1);
+            if(L == ColumnMajor)
+            {
+                lineExchange(i, j);
+            }
+            else
             {
-                T temp = m_Mat[k][j];
-                m_Mat[k][j] = m_Mat[k][i];
-                m_Mat[k][i] = temp;
+                crossExchange(i, j);
             }
         }
     }
 
-    template<typename T>
-    void Matrix<T>::columnMultiply(unsigned int i, const T value)
+    template<typename T, typename Alloc, Layout L>
+    void Matrix<T, Alloc, L>::columnMultiply(unsigned int i, const T value)
     {
         if( i >= m_M)
         {
@@ -476,15 +774,20 @@ namespace Cubical
         }
         else
         {
-            for(unsigned int j = 0; j < m_N; j++)
+            CUBICAL_STATS_ADD(elementaryOperations, 1);
+            if(L == ColumnMajor)
+            {
+                lineMultiply(i, value);
+            }
+            else
             {
-                m_Mat[j][i] *= value;
+                crossMultiply(i, value);
             }
         }
     }
 
-    template<typename T>
-    void Matrix<T>::columnAdd(unsigned int i, unsigned int j, const T value)
+    template<typename T, typename Alloc, Layout L>
+    void Matrix<T, Alloc, L>::columnAdd(unsigned int i, unsigned int j, const T value)
     {
         if( i >= m_M || j >= m_M)
         {
@@ -493,26 +796,109 @@ namespace Cubical
         }
         else
         {
-            for(unsigned int k = 0; k < m_N; k++)
+            CUBICAL_STATS_ADD(elementaryOperations, 1);
+            if(L == ColumnMajor)
             {
-                m_Mat[k][i] += value * m_Mat[k][j];
+                lineAdd(i, j, value);
+            }
+            else
+            {
+                crossAdd(i, j, value);
             }
         }
     }
 
-    template<typename T>
-    void Matrix<T>::print()
+    template<typename T, typename Alloc, Layout L>
+    void Matrix<T, Alloc, L>::lineExchange(unsigned int i, unsigned int j)
+    {
+        std::swap(m_Lines[i], m_Lines[j]);
+    }
+
+    template<typename T, typename Alloc, Layout L>
+    void Matrix<T, Alloc, L>::lineMultiply(unsigned int i, const T value)
+    {
+        T* a = line(i);
+        for(unsigned int k = 0; k < getLineLength(); k++)
+        {
+            a[k] *= value;
+        }
+    }
+
+    template<typename T, typename Alloc, Layout L>
+    void Matrix<T, Alloc, L>::lineAdd(unsigned int i, unsigned int j, const T value)
+    {
+        addScaled(line(i), line(j), value, getLineLength());
+    }
+
+    template<typename T, typename Alloc, Layout L>
+    void Matrix<T, Alloc, L>::crossExchange(unsigned int i, unsigned int j)
+    {
+        //  walk the physical lines in storage order
+        for(T* a = m_Data.data(); a != m_Data.data() + m_Data.size(); a += getLineLength())
+        {
+            std::swap(a[i], a[j]);
+        }
+    }
+
+    template<typename T, typename Alloc, Layout L>
+    void Matrix<T, Alloc, L>::crossMultiply(unsigned int i, const T value)
+    {
+        for(T* a = m_Data.data(); a != m_Data.data() + m_Data.size(); a += getLineLength())
+        {
+            a[i] *= value;
+        }
+    }
+
+    template<typename T, typename Alloc, Layout L>
+    void Matrix<T, Alloc, L>::crossAdd(unsigned int i, unsigned int j, const T value)
+    {
+        for(T* a = m_Data.data(); a != m_Data.data() + m_Data.size(); a += getLineLength())
+        {
+            a[i] += value * a[j];
+        }
+    }
+
+    template<typename T, typename Alloc, Layout L>
+    void Matrix<T, Alloc, L>::print()
     {
         std::cout << "\n[ ";
         for(unsigned int i = 0; i < m_N; i++)
         {
             for(unsigned int j = 0; j < m_M; j++)
             {
-                std::cout << m_Mat[i][j] << " ";
+                std::cout << at(i, j) << " ";
             }
             if(i < m_N - 1) std::cout << "\n  ";
         }
         std::cout << "]\n";
     }
 
+    template<typename T, typename Alloc, Layout L>
+    bool Matrix<T, Alloc, L>::save(const std::string& filename) const
+    {
+        if constexpr(L == ColumnMajor)
+        {
+            return Matrix<T, Alloc, RowMajor>(*this).save(filename);
+        }
+        //  rows are written in logical order, so exchanged rows need a copy
+        std::vector<T> ordered;
+        const T* data = m_Data.data();
+        for(unsigned int i = 0; i < m_N; i++)
+        {
+            if(m_Lines[i] != i)
+            {
+                ordered.reserve(m_Data.size());
+                for(unsigned int k = 0; k < m_N; k++)
+                {
+                    ordered.insert(ordered.end(), line(k), line(k) + m_M);
+                }
+                data = ordered.data();
+                break;
+            }
+        }
+        std::vector<std::pair<const void*, size_t> > sections;
+        sections.push_back(std::make_pair((const void*)data, m_Data.size() * sizeof(T)));
+        return writeMatrixFile(filename, makeMatrixFileHeader<T>(m_N, m_M, false, m_Data.size()), sections);
+    }
+
 }
\ No newline at end of file
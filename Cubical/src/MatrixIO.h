@@ -0,0 +1,343 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cstdint>
+#include <limits>
+#include <charconv>
+#include <type_traits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "Z2.h"
+
+namespace Cubical
+{
+    //  read-only memory map of a whole file
+    class MappedFile
+    {
+        public:
+            MappedFile() : m_Data(nullptr), m_Size(0) {}
+            MappedFile(const std::string& filename);
+            MappedFile(MappedFile&& other) : m_Data(other.m_Data), m_Size(other.m_Size)
+            {
+                other.m_Data = nullptr;
+                other.m_Size = 0;
+            }
+            MappedFile(const MappedFile&) = delete;
+            MappedFile& operator=(const MappedFile&) = delete;
+            virtual ~MappedFile();
+
+            //  getters and setters
+            bool isOpen() const { return m_Data != nullptr; }
+            const char* getData() const { return (const char*)m_Data; }
+            size_t getSize() const { return m_Size; }
+
+        private:
+            void* m_Data;
+            size_t m_Size;
+    };
+
+    inline MappedFile::MappedFile(const std::string& filename) : m_Data(nullptr), m_Size(0)
+    {
+        int fd = open(filename.c_str(), O_RDONLY);
+        if(fd < 0)
+        {
+            return;
+        }
+        struct stat info;
+        if(fstat(fd, &info) == 0 && info.st_size > 0)
+        {
+            void* data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(data != MAP_FAILED)
+            {
+                madvise(data, info.st_size, MADV_SEQUENTIAL);
+                m_Data = data;
+                m_Size = info.st_size;
+            }
+        }
+        close(fd);
+    }
+
+    inline MappedFile::~MappedFile()
+    {
+        if(m_Data)
+        {
+            munmap(m_Data, m_Size);
+        }
+    }
+
+    //  Binary matrix files start with this header, followed by the
+    //  payload sections, each starting on a 64 byte boundary. Dense files
+    //  hold the n * m values row by row. Sparse files are compressed by
+    //  column: m + 1 column offsets (uint64), then the row of every
+    //  non-zero (uint32), then the values.
+    struct MatrixFileHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t type;
+        uint32_t sparse;
+        uint32_t valueSize;
+        uint64_t n;
+        uint64_t m;
+        uint64_t nonZeros;
+    };
+
+    const char MatrixFileMagic[8] = {'C', 'U', 'B', 'M', 'A', 'T', 0, 0};
+    const uint32_t MatrixFileVersion = 1;
+    const size_t MatrixFileAlignment = 64;
+
+    //  value type codes stored in the header
+    enum MatrixFileType : uint32_t
+    {
+        MatrixFileUnknown = 0,
+        MatrixFileInt8, MatrixFileUInt8, MatrixFileInt16, MatrixFileUInt16,
+        MatrixFileInt32, MatrixFileUInt32, MatrixFileInt64, MatrixFileUInt64,
+        MatrixFileFloat32, MatrixFileFloat64, MatrixFileZ2
+    };
+
+    template<typename T>
+    struct MatrixFileTraits
+    {
+        static const uint32_t type =
+            std::is_same<T, Z2>::value ? MatrixFileZ2 :
+            std::is_floating_point<T>::value ? (sizeof(T) == 4 ? MatrixFileFloat32 : sizeof(T) == 8 ? MatrixFileFloat64 : MatrixFileUnknown) :
+            !std::is_integral<T>::value ? MatrixFileUnknown :
+            sizeof(T) == 1 ? (std::is_signed<T>::value ? MatrixFileInt8 : MatrixFileUInt8) :
+            sizeof(T) == 2 ? (std::is_signed<T>::value ? MatrixFileInt16 : MatrixFileUInt16) :
+            sizeof(T) == 4 ? (std::is_signed<T>::value ? MatrixFileInt32 : MatrixFileUInt32) :
+            sizeof(T) == 8 ? (std::is_signed<T>::value ? MatrixFileInt64 : MatrixFileUInt64) : MatrixFileUnknown;
+    };
+
+    inline size_t alignMatrixFile(size_t offset)
+    {
+        return (offset + MatrixFileAlignment - 1) / MatrixFileAlignment * MatrixFileAlignment;
+    }
+
+    inline bool isMatrixFile(const char* data, size_t size)
+    {
+        return size >= sizeof(MatrixFileHeader) && std::memcmp(data, MatrixFileMagic, sizeof(MatrixFileMagic)) == 0;
+    }
+
+    //  Zero-copy view of a binary matrix file, the arrays point straight
+    //  into the mapping and stay valid while this object lives.
+    template<typename T>
+    class MappedMatrix
+    {
+        public:
+            MappedMatrix<T>(const std::string& filename) : MappedMatrix<T>(MappedFile(filename)) {}
+            MappedMatrix<T>(MappedFile&& file);
+            virtual ~MappedMatrix<T>() {}
+
+            //  getters and setters
+            bool isValid() const { return m_Header != nullptr; }
+            bool isSparse() const { return m_Header->sparse != 0; }
+            unsigned int getN() const { return m_Header->n; }
+            unsigned int getM() const { return m_Header->m; }
+            size_t getNonZeros() const { return m_Header->nonZeros; }
+            //  dense values, row by row
+            const T* getData() const { return m_Values; }
+            //  sparse columns, column j has entries [offsets[j], offsets[j + 1])
+            const uint64_t* getColumnOffsets() const { return m_Offsets; }
+            const uint32_t* getRowIndices() const { return m_Indices; }
+            const T* getValues() const { return m_Values; }
+
+        private:
+            MappedFile m_File;
+            const MatrixFileHeader* m_Header;
+            const uint64_t* m_Offsets;
+            const uint32_t* m_Indices;
+            const T* m_Values;
+    };
+
+    template<typename T>
+    MappedMatrix<T>::MappedMatrix(MappedFile&& file)
+    : m_File(std::move(file)), m_Header(nullptr), m_Offsets(nullptr), m_Indices(nullptr), m_Values(nullptr)
+    {
+        if(!isMatrixFile(m_File.getData(), m_File.getSize()))
+        {
+            std::cout << "ERROR! File is not a binary matrix file!" << std::endl;
+            return;
+        }
+        const MatrixFileHeader* header = (const MatrixFileHeader*)m_File.getData();
+        if(header->version != MatrixFileVersion || header->type != MatrixFileTraits<T>::type || header->valueSize != sizeof(T))
+        {
+            std::cout << "ERROR! Matrix file holds values of type " << header->type
+                      << " but type " << MatrixFileTraits<T>::type << " was requested!" << std::endl;
+            return;
+        }
+        //  the sizes come from the file, so each section is checked against
+        //  the bytes left before it is used, which also rules out overflow
+        const uint64_t limit = std::numeric_limits<unsigned int>::max();
+        if(header->n > limit || header->m > limit)
+        {
+            std::cout << "ERROR! Matrix file of size (" << header->n << "," << header->m << ") is too large!" << std::endl;
+            return;
+        }
+        size_t size = m_File.getSize();
+        size_t offset = alignMatrixFile(sizeof(MatrixFileHeader));
+        uint64_t count = header->sparse ? header->nonZeros : header->n * header->m;
+        if(header->sparse)
+        {
+            if(offset > size || header->m + 1 > (size - offset) / sizeof(uint64_t))
+            {
+                std::cout << "ERROR! Matrix file is truncated!" << std::endl;
+                return;
+            }
+            m_Offsets = (const uint64_t*)(m_File.getData() + offset);
+            offset = alignMatrixFile(offset + (header->m + 1) * sizeof(uint64_t));
+            if(offset > size || header->nonZeros > (size - offset) / sizeof(uint32_t))
+            {
+                std::cout << "ERROR! Matrix file is truncated!" << std::endl;
+                return;
+            }
+            m_Indices = (const uint32_t*)(m_File.getData() + offset);
+            offset = alignMatrixFile(offset + header->nonZeros * sizeof(uint32_t));
+        }
+        if(offset > size || count > (size - offset) / sizeof(T))
+        {
+            std::cout << "ERROR! Matrix file is truncated!" << std::endl;
+            return;
+        }
+        if(header->sparse)
+        {
+            //  columns are read as [offsets[j], offsets[j + 1]), which must
+            //  stay within the non-zeros
+            bool valid = m_Offsets[0] == 0 && m_Offsets[header->m] == header->nonZeros;
+            for(uint64_t j = 0; j < header->m && valid; j++)
+            {
+                valid = m_Offsets[j] <= m_Offsets[j + 1];
+            }
+            if(!valid)
+            {
+                std::cout << "ERROR! Matrix file has invalid column offsets!" << std::endl;
+                return;
+            }
+        }
+        m_Values = (const T*)(m_File.getData() + offset);
+        m_Header = header;
+    }
+
+    //  writes a binary matrix file from its header and payload sections
+    inline bool writeMatrixFile(const std::string& filename, const MatrixFileHeader& header,
+                                const std::vector<std::pair<const void*, size_t> >& sections)
+    {
+        std::ofstream file(filename, std::ios::binary);
+        if(!file)
+        {
+            std::cout << "ERROR! Could not open " << filename << " for writing!" << std::endl;
+            return false;
+        }
+        const char padding[MatrixFileAlignment] = {};
+        size_t offset = sizeof(MatrixFileHeader);
+        file.write((const char*)&header, sizeof(MatrixFileHeader));
+        for(size_t k = 0; k < sections.size(); k++)
+        {
+            file.write(padding, alignMatrixFile(offset) - offset);
+            offset = alignMatrixFile(offset);
+            file.write((const char*)sections[k].first, sections[k].second);
+            offset += sections[k].second;
+        }
+        return (bool)file;
+    }
+
+    template<typename T>
+    MatrixFileHeader makeMatrixFileHeader(unsigned int n, unsigned int m, bool sparse, size_t nonZeros)
+    {
+        MatrixFileHeader header;
+        std::memcpy(header.magic, MatrixFileMagic, sizeof(MatrixFileMagic));
+        header.version = MatrixFileVersion;
+        header.type = MatrixFileTraits<T>::type;
+        header.sparse = sparse;
+        header.valueSize = sizeof(T);
+        header.n = n;
+        header.m = m;
+        header.nonZeros = nonZeros;
+        return header;
+    }
+
+    //  parses one number with from_chars, types without a from_chars
+    //  overload such as Z2 are read through a long long
+    template<typename T>
+    const char* parseMatrixValue(const char* first, const char* last, T& value)
+    {
+        if constexpr(std::is_arithmetic<T>::value)
+        {
+            std::from_chars_result result = std::from_chars(first, last, value);
+            return result.ec == std::errc() ? result.ptr : nullptr;
+        }
+        else
+        {
+            long long temp = 0;
+            std::from_chars_result result = std::from_chars(first, last, temp);
+            value = T(temp);
+            return result.ec == std::errc() ? result.ptr : nullptr;
+        }
+    }
+
+    //  Parses a text matrix, one row per line with entries separated by
+    //  whitespace or commas. Blank lines and lines starting with # are
+    //  skipped. The values are appended row by row to data.
+    template<typename T, typename Alloc>
+    bool parseMatrixText(const char* first, const char* last, unsigned int& n, unsigned int& m, std::vector<T, Alloc>& data)
+    {
+        n = 0;
+        m = 0;
+        data.clear();
+        const char* p = first;
+        while(p < last)
+        {
+            if(*p == '#')
+            {
+                while(p < last && *p != '\n')
+                {
+                    p++;
+                }
+                continue;
+            }
+            unsigned int columns = 0;
+            while(p < last && *p != '\n')
+            {
+                if(*p == ' ' || *p == '\t' || *p == ',' || *p == '\r')
+                {
+                    p++;
+                    continue;
+                }
+                if(*p == '+')
+                {
+                    p++;
+                }
+                T value;
+                const char* next = parseMatrixValue(p, last, value);
+                if(!next)
+                {
+                    std::cout << "ERROR! Could not parse matrix entry in row " << n << "!" << std::endl;
+                    return false;
+                }
+                data.push_back(value);
+                columns++;
+                p = next;
+            }
+            p++;
+            if(columns == 0)
+            {
+                continue;
+            }
+            if(n > 0 && columns != m)
+            {
+                std::cout << "ERROR! Row " << n << " has " << columns << " entries instead of " << m << "!" << std::endl;
+                return false;
+            }
+            m = columns;
+            n++;
+        }
+        return true;
+    }
+
+}
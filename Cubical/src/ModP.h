@@ -0,0 +1,492 @@
+#pragma once
+
+#include <vector>
+#include <iostream>
+#include <cstdint>
+#include <limits>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
+#include "SparseMatrix.h"
+#include "CubicalComplex.h"
+#include "Z2.h"
+
+namespace Cubical
+{
+    //  trial division, only used on moduli
+    constexpr bool isPrime(uint32_t p)
+    {
+        if(p < 2)
+        {
+            return false;
+        }
+        for(uint32_t d = 2; (uint64_t)d * d <= p; d++)
+        {
+            if(p % d == 0)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    //  Inverses modulo primes up to this size come from a table
+    //  built once, larger ones by exponentiation.
+    const uint32_t InverseTableSize = 1u << 16;
+
+    //  inverse of every residue modulo p by inv(i) = -(p / i) inv(p mod i)
+    inline std::vector<uint32_t> makeInverseTable(uint32_t p)
+    {
+        std::vector<uint32_t> inverses(p, 0);
+        if(p > 1)
+        {
+            inverses[1] = 1;
+        }
+        for(uint32_t i = 2; i < p; i++)
+        {
+            inverses[i] = p - (uint32_t)((uint64_t)(p / i) * inverses[p % i] % p);
+        }
+        return inverses;
+    }
+
+    //  Barrett reduction of x < 2^64 with m = floor(2^64 / p), the
+    //  estimated quotient is at most one short so one subtraction remains
+    inline uint32_t barrettReduce(uint64_t x, uint32_t p, uint64_t m)
+    {
+        uint64_t q = (uint64_t)(((unsigned __int128)x * m) >> 64);
+        uint64_t r = x - q * p;
+        return (uint32_t)(r >= p ? r - p : r);
+    }
+
+    //  Element of the prime field Z/P, P fixed at compile time. Residues
+    //  are kept in [0, P) and products reduced by Barrett reduction.
+    template<uint32_t P>
+    class ModP
+    {
+        static_assert(isPrime(P) && P < (1u << 31), "ModP needs a prime modulus below 2^31!");
+
+        public:
+            static const uint32_t Prime = P;
+
+            ModP() : m_Value(0) {}
+            ModP(int value) : m_Value(fromInteger(value)) {}
+            ModP(long long value) : m_Value(fromInteger(value)) {}
+
+            //  getters and setters
+            uint32_t getValue() const { return m_Value; }
+            //  multiplicative inverse, zero has none and maps to zero
+            ModP<P> inverse() const;
+
+            //  operator overloads
+            explicit operator bool() const { return m_Value != 0; }
+            ModP<P> operator-() const { return fromResidue(m_Value ? P - m_Value : 0); }
+            //  addition
+            ModP<P> operator+(const ModP<P> other) const { return fromResidue(add(m_Value, other.m_Value)); }
+            void operator+=(const ModP<P> other) { m_Value = add(m_Value, other.m_Value); }
+            //  subtraction
+            ModP<P> operator-(const ModP<P> other) const { return fromResidue(subtract(m_Value, other.m_Value)); }
+            void operator-=(const ModP<P> other) { m_Value = subtract(m_Value, other.m_Value); }
+            //  multiplication
+            ModP<P> operator*(const ModP<P> other) const { return fromResidue(multiply(m_Value, other.m_Value)); }
+            void operator*=(const ModP<P> other) { m_Value = multiply(m_Value, other.m_Value); }
+            //  division, only defined for a non-zero divisor
+            ModP<P> operator/(const ModP<P> other) const { return *this * other.inverse(); }
+            void operator/=(const ModP<P> other) { *this = *this / other; }
+            //  comparison
+            bool operator==(const ModP<P> other) const { return m_Value == other.m_Value; }
+            bool operator!=(const ModP<P> other) const { return m_Value != other.m_Value; }
+
+            //  residue in [0, P) taken as is
+            static ModP<P> fromResidue(uint32_t residue)
+            {
+                ModP<P> temp;
+                temp.m_Value = residue;
+                return temp;
+            }
+
+        private:
+            static const uint64_t Barrett = ~(uint64_t)0 / P;
+
+            uint32_t m_Value;
+
+            static uint32_t fromInteger(long long value)
+            {
+                long long r = value % (long long)P;
+                return (uint32_t)(r < 0 ? r + P : r);
+            }
+            static uint32_t add(uint32_t a, uint32_t b) { uint32_t s = a + b; return s >= P ? s - P : s; }
+            static uint32_t subtract(uint32_t a, uint32_t b) { return a >= b ? a - b : a + P - b; }
+            static uint32_t multiply(uint32_t a, uint32_t b) { return barrettReduce((uint64_t)a * b, P, Barrett); }
+    };
+
+    template<uint32_t P>
+    ModP<P> ModP<P>::inverse() const
+    {
+        if(P <= InverseTableSize)
+        {
+            static const std::vector<uint32_t> inverses = makeInverseTable(P);
+            return fromResidue(inverses[m_Value]);
+        }
+        //  a^(P - 2) by Fermat
+        uint32_t result = 1;
+        uint32_t base = m_Value;
+        for(uint32_t e = P - 2; e > 0; e >>= 1)
+        {
+            if(e & 1)
+            {
+                result = multiply(result, base);
+            }
+            base = multiply(base, base);
+        }
+        return fromResidue(result);
+    }
+
+    template<uint32_t P>
+    std::ostream& operator<<(std::ostream& os, const ModP<P> value)
+    {
+        return os << value.getValue();
+    }
+
+    //  Odd prime modulus chosen at run time with its Montgomery constants,
+    //  R = 2^32. Moduli that are not odd primes below 2^31 are invalid.
+    class Modulus
+    {
+        public:
+            explicit Modulus(uint32_t p);
+            Modulus(const Modulus&) = delete;
+            Modulus& operator=(const Modulus&) = delete;
+            virtual ~Modulus() {}
+
+            //  getters and setters
+            uint32_t getP() const { return m_P; }
+            bool isValid() const { return m_P != 0; }
+
+            //  t R^-1 mod p for t < p 2^32
+            uint32_t reduce(uint64_t t) const
+            {
+                uint32_t m = (uint32_t)t * m_Negative;
+                uint64_t u = (t + (uint64_t)m * m_P) >> 32;
+                return (uint32_t)(u >= m_P ? u - m_P : u);
+            }
+            uint32_t toMontgomery(uint32_t a) const { return reduce((uint64_t)a * m_R2); }
+            uint32_t fromMontgomery(uint32_t a) const { return reduce(a); }
+            //  inverse of a residue in plain form
+            uint32_t inverse(uint32_t a) const;
+
+        private:
+            uint32_t m_P;
+            //  -p^-1 mod 2^32 and R^2 mod p
+            uint32_t m_Negative;
+            uint32_t m_R2;
+            std::vector<uint32_t> m_Inverses;
+    };
+
+    inline Modulus::Modulus(uint32_t p) : m_P(0), m_Negative(0), m_R2(0)
+    {
+        if(p < 3 || p >= (1u << 31) || !isPrime(p))
+        {
+            std::cout << "ERROR! Modulus " << p << " is not an odd prime below 2^31!" << std::endl;
+            return;
+        }
+        m_P = p;
+        //  Newton iteration doubles the correct low bits of p^-1
+        uint32_t inverse = p;
+        for(unsigned int k = 0; k < 4; k++)
+        {
+            inverse *= 2 - p * inverse;
+        }
+        m_Negative = 0 - inverse;
+        m_R2 = (uint32_t)(((unsigned __int128)1 << 64) % p);
+        if(p <= InverseTableSize)
+        {
+            m_Inverses = makeInverseTable(p);
+        }
+    }
+
+    inline uint32_t Modulus::inverse(uint32_t a) const
+    {
+        if(!m_Inverses.empty())
+        {
+            return m_Inverses[a];
+        }
+        uint64_t result = 1;
+        uint64_t base = a;
+        for(uint32_t e = m_P - 2; e > 0; e >>= 1)
+        {
+            if(e & 1)
+            {
+                result = result * base % m_P;
+            }
+            base = base * base % m_P;
+        }
+        return (uint32_t)result;
+    }
+
+    //  Element of Z/p for the modulus active on the calling thread, set
+    //  with a ModulusScope. Values are kept in Montgomery form a R mod p,
+    //  so products need no division. Zero is zero for every modulus.
+    class DynamicModP
+    {
+        public:
+            DynamicModP() : m_Value(0) {}
+            DynamicModP(int value) : m_Value(fromInteger(value)) {}
+            DynamicModP(long long value) : m_Value(fromInteger(value)) {}
+
+            //  getters and setters
+            static const Modulus* getModulus() { return current(); }
+            //  residue in [0, p)
+            uint32_t getValue() const { return current()->fromMontgomery(m_Value); }
+            //  Montgomery form a R mod p
+            uint32_t getMontgomery() const { return m_Value; }
+            DynamicModP inverse() const;
+
+            //  operator overloads
+            explicit operator bool() const { return m_Value != 0; }
+            DynamicModP operator-() const { return fromMontgomery(m_Value ? p() - m_Value : 0); }
+            //  addition
+            DynamicModP operator+(const DynamicModP other) const { return fromMontgomery(add(m_Value, other.m_Value)); }
+            void operator+=(const DynamicModP other) { m_Value = add(m_Value, other.m_Value); }
+            //  subtraction
+            DynamicModP operator-(const DynamicModP other) const { return fromMontgomery(subtract(m_Value, other.m_Value)); }
+            void operator-=(const DynamicModP other) { m_Value = subtract(m_Value, other.m_Value); }
+            //  multiplication
+            DynamicModP operator*(const DynamicModP other) const { return fromMontgomery(current()->reduce((uint64_t)m_Value * other.m_Value)); }
+            void operator*=(const DynamicModP other) { m_Value = current()->reduce((uint64_t)m_Value * other.m_Value); }
+            //  division, only defined for a non-zero divisor
+            DynamicModP operator/(const DynamicModP other) const { return *this * other.inverse(); }
+            void operator/=(const DynamicModP other) { *this = *this / other; }
+            //  comparison, the Montgomery form is unique
+            bool operator==(const DynamicModP other) const { return m_Value == other.m_Value; }
+            bool operator!=(const DynamicModP other) const { return m_Value != other.m_Value; }
+
+            static DynamicModP fromMontgomery(uint32_t value)
+            {
+                DynamicModP temp;
+                temp.m_Value = value;
+                return temp;
+            }
+
+        private:
+            friend class ModulusScope;
+
+            uint32_t m_Value;
+
+            static const Modulus*& current()
+            {
+                static thread_local const Modulus* modulus = nullptr;
+                return modulus;
+            }
+            static uint32_t p() { return current()->getP(); }
+            static uint32_t fromInteger(long long value)
+            {
+                long long r = value % (long long)p();
+                return current()->toMontgomery((uint32_t)(r < 0 ? r + p() : r));
+            }
+            static uint32_t add(uint32_t a, uint32_t b) { uint32_t s = a + b; return s >= p() ? s - p() : s; }
+            static uint32_t subtract(uint32_t a, uint32_t b) { return a >= b ? a - b : a + p() - b; }
+    };
+
+    inline DynamicModP DynamicModP::inverse() const
+    {
+        const Modulus* modulus = current();
+        return fromMontgomery(modulus->toMontgomery(modulus->inverse(modulus->fromMontgomery(m_Value))));
+    }
+
+    inline std::ostream& operator<<(std::ostream& os, const DynamicModP value)
+    {
+        return os << value.getValue();
+    }
+
+    //  Makes a modulus the active one of this thread until the scope ends.
+    //  Values of different moduli must not be mixed.
+    class ModulusScope
+    {
+        public:
+            explicit ModulusScope(const Modulus& modulus) : m_Previous(DynamicModP::current())
+            {
+                DynamicModP::current() = &modulus;
+            }
+            ModulusScope(const ModulusScope&) = delete;
+            ModulusScope& operator=(const ModulusScope&) = delete;
+            virtual ~ModulusScope() { DynamicModP::current() = m_Previous; }
+
+        private:
+            const Modulus* m_Previous;
+    };
+
+    //  y += a x on residues in [0, p), p < 2^31, four lanes at a time. The
+    //  products use Shoup's precomputed quotient floor(a 2^32 / p), which
+    //  leaves a remainder in [0, 2p) and needs no 128-bit arithmetic.
+    inline void addScaledResidues(uint32_t* y, const uint32_t* x, uint32_t a, uint32_t p, size_t n)
+    {
+        typedef uint64_t Lane __attribute__((vector_size(32)));
+        const uint64_t shoup = ((uint64_t)a << 32) / p;
+        const uint64_t mask = 0xffffffff;
+        size_t k = 0;
+        for(; k + 4 <= n; k += 4)
+        {
+            Lane xv = {x[k], x[k + 1], x[k + 2], x[k + 3]};
+            Lane yv = {y[k], y[k + 1], y[k + 2], y[k + 3]};
+            Lane q = (xv * shoup) >> 32;
+            Lane r = (xv * a - q * p) & mask;
+            r -= (Lane)(r >= p) & p;
+            Lane s = yv + r;
+            s -= (Lane)(s >= p) & p;
+            for(unsigned int l = 0; l < 4; l++)
+            {
+                y[k + l] = (uint32_t)s[l];
+            }
+        }
+        for(; k < n; k++)
+        {
+            uint64_t q = ((uint64_t)x[k] * shoup) >> 32;
+            uint32_t r = (uint32_t)(((uint64_t)x[k] * a - q * p) & mask);
+            r = r >= p ? r - p : r;
+            uint32_t s = y[k] + r;
+            y[k] = s >= p ? s - p : s;
+        }
+    }
+
+    //  row additions of Matrix over prime fields, see addScaled in Matrix.h
+    template<uint32_t P>
+    void addScaled(ModP<P>* y, const ModP<P>* x, const ModP<P> a, size_t n)
+    {
+        static_assert(sizeof(ModP<P>) == sizeof(uint32_t), "ModP must be a bare residue!");
+        addScaledResidues((uint32_t*)y, (const uint32_t*)x, a.getValue(), P, n);
+    }
+
+    //  a (x R) = (a x) R, so Montgomery forms are scaled by the plain value of a
+    inline void addScaled(DynamicModP* y, const DynamicModP* x, const DynamicModP a, size_t n)
+    {
+        static_assert(sizeof(DynamicModP) == sizeof(uint32_t), "DynamicModP must be a bare residue!");
+        addScaledResidues((uint32_t*)y, (const uint32_t*)x, a.getValue(), DynamicModP::getModulus()->getP(), n);
+    }
+
+    //  pivot size and normalizing unit in the Smith normal form,
+    //  every non-zero element of a field is a unit
+    template<uint32_t P>
+    int snfMagnitude(const ModP<P> value) { return value ? 1 : 0; }
+    template<uint32_t P>
+    ModP<P> snfUnit(const ModP<P> value) { return value ? value.inverse() : ModP<P>(1); }
+    inline int snfMagnitude(const DynamicModP value) { return value ? 1 : 0; }
+    inline DynamicModP snfUnit(const DynamicModP value) { return value ? value.inverse() : DynamicModP(1); }
+
+    //  Rank over the field F by reducing the columns from left to right,
+    //  each against the column owning its pivot. Entries are converted
+    //  to F, so a matrix over Z gives its rank modulo p.
+    template<typename F, typename T, typename A>
+    unsigned int fieldRank(const SparseMatrix<T, A>& a)
+    {
+        std::vector<SparseColumn<F> > columns(a.getM());
+        std::vector<unsigned int> pivots(a.getN(), std::numeric_limits<unsigned int>::max());
+        unsigned int rank = 0;
+        for(unsigned int j = 0; j < a.getM(); j++)
+        {
+            SparseColumn<F>& column = columns[j];
+            for(unsigned int k = 0; k < a.getColumn(j).getNonZeros(); k++)
+            {
+                F value = F((long long)a.getColumn(j).getValue(k));
+                if(value != F())
+                {
+                    column.append(a.getColumn(j).getRow(k), value);
+                }
+            }
+            while(!column.isEmpty())
+            {
+                unsigned int r = column.getPivot();
+                unsigned int k = pivots[r];
+                if(k == std::numeric_limits<unsigned int>::max())
+                {
+                    pivots[r] = j;
+                    rank++;
+                    break;
+                }
+                const SparseColumn<F>& other = columns[k];
+                F value = column.getValue(column.getNonZeros() - 1);
+                F pivot = other.getValue(other.getNonZeros() - 1);
+                column.add(other, -(value / pivot));
+            }
+        }
+        return rank;
+    }
+
+    //  Runs f(k, p) for every prime p = primes[k], spread over threads.
+    //  Each call runs with p as the active DynamicModP modulus, except
+    //  p = 2 which Montgomery form cannot represent and should use Z2.
+    template<typename F>
+    void forEachPrime(const std::vector<uint32_t>& primes, unsigned int threads, F f)
+    {
+        std::atomic<size_t> next(0);
+        auto worker = [&]()
+        {
+            for(size_t k = next++; k < primes.size(); k = next++)
+            {
+                if(primes[k] == 2)
+                {
+                    f(k, primes[k]);
+                    continue;
+                }
+                Modulus modulus(primes[k]);
+                if(!modulus.isValid())
+                {
+                    continue;
+                }
+                ModulusScope scope(modulus);
+                f(k, primes[k]);
+            }
+        };
+        unsigned int workers = (unsigned int)std::max((size_t)1, std::min((size_t)std::max(threads, 1u), primes.size()));
+        if(workers == 1)
+        {
+            worker();
+            return;
+        }
+        std::vector<std::thread> pool;
+        for(unsigned int t = 0; t < workers; t++)
+        {
+            pool.push_back(std::thread(worker));
+        }
+        for(unsigned int t = 0; t < workers; t++)
+        {
+            pool[t].join();
+        }
+    }
+
+    //  Betti numbers of the sublevel set at threshold over Z/p for each
+    //  prime, one row per prime indexed by dimension, empty for invalid
+    //  primes. A Betti number that is larger modulo p than modulo other
+    //  primes reveals p-torsion in the integral homology.
+    template<typename T>
+    std::vector<std::vector<unsigned int> > bettiModPrimes(const CubicalComplex<T>& complex, const std::vector<uint32_t>& primes,
+                                                           unsigned int threads = 1, const T threshold = std::numeric_limits<T>::max())
+    {
+        unsigned int dim = complex.getDim();
+        std::vector<SparseMatrix<int> > boundaries(dim + 1);
+        std::vector<unsigned int> cells(dim + 1);
+        for(unsigned int d = 0; d <= dim; d++)
+        {
+            cells[d] = complex.getCells(d, threshold).size();
+            if(d > 0)
+            {
+                boundaries[d] = complex.template getBoundary<int>(d, threshold);
+            }
+        }
+        std::vector<std::vector<unsigned int> > betti(primes.size());
+        forEachPrime(primes, threads, [&](size_t k, uint32_t p)
+        {
+            std::vector<unsigned int> ranks(dim + 2, 0);
+            for(unsigned int d = 1; d <= dim; d++)
+            {
+                ranks[d] = p == 2 ? fieldRank<Z2>(boundaries[d]) : fieldRank<DynamicModP>(boundaries[d]);
+            }
+            betti[k].resize(dim + 1);
+            for(unsigned int d = 0; d <= dim; d++)
+            {
+                betti[k][d] = cells[d] - ranks[d] - ranks[d + 1];
+            }
+        });
+        return betti;
+    }
+
+}
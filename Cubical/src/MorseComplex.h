@@ -0,0 +1,408 @@
+#pragma once
+
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <thread>
+#include <atomic>
+#include <utility>
+
+#include "CubicalComplex.h"
+#include "Persistence.h"
+#include "SparseMatrix.h"
+#include "Stats.h"
+#include "Z2.h"
+
+namespace Cubical
+{
+    //  Discrete Morse reduction of the sublevel filtration of a cubical
+    //  complex. Cells are ordered as in Persistence, by value, then
+    //  dimension, then index. A cell σ is matched with a coface τ when σ
+    //  is the youngest face of τ, τ is the oldest coface of σ and both
+    //  have the same value. Such apparent pairs form an acyclic matching,
+    //  and pairing only cells of equal value keeps it inside the levels of
+    //  the filtration, so the unmatched critical cells span a Morse
+    //  complex with the same homology and persistence. On images with
+    //  large flat regions nearly all cells are matched.
+    //
+    //  Whether a cell is matched only depends on its faces and cofaces, so
+    //  the matching is computed over blocks of cells in parallel. The
+    //  Morse boundary of a critical cell follows the gradient paths from
+    //  its faces, each matched face being replaced by the other faces of
+    //  its partner, youngest first, until only critical cells remain.
+    //  Columns are independent and split across threads as well.
+    template<typename T>
+    class MorseComplex
+    {
+        public:
+            MorseComplex<T>(const CubicalComplex<T>& complex, unsigned int threads = 1);
+            virtual ~MorseComplex<T>();
+
+            //  getters and setters
+            const CubicalComplex<T>& getComplex() const { return m_Complex; }
+            //  critical cells of dimension dim in filtration order
+            const std::vector<size_t>& getCritical(unsigned int dim) const { return m_Critical[dim]; }
+            size_t getCriticalCells() const;
+            //  the cell matched with cell, or cell itself if it is critical
+            size_t getPartner(size_t cell) const { return m_Partner[cell]; }
+            bool isCritical(size_t cell) const { return m_Partner[cell] == cell; }
+
+            //  Morse boundary from the critical dim-cells to the critical
+            //  (dim - 1)-cells, indexed in the order of getCritical. With
+            //  integer coefficients it has the homology of getBoundary.
+            template<typename S>
+            SparseMatrix<S> getBoundary(unsigned int dim) const;
+            //  persistence over Z/2 from the Morse boundaries, the same
+            //  pairs as Persistence of the full complex
+            std::vector<PersistencePair<T> > getPersistence() const;
+
+            void print();
+
+        private:
+            const CubicalComplex<T>& m_Complex;
+            unsigned int m_Threads;
+            std::vector<size_t> m_Partner;
+            std::vector<std::vector<size_t> > m_Critical;
+
+            //  filtration order of cells of the same dimension
+            bool isOlder(size_t a, size_t b) const
+            {
+                T va = m_Complex.getValue(a);
+                T vb = m_Complex.getValue(b);
+                return va < vb || (va == vb && a < b);
+            }
+            size_t findPartner(size_t cell) const;
+            size_t getYoungestFace(size_t cell) const;
+            size_t getOldestCoface(size_t cell) const;
+            void match();
+            template<typename S>
+            void flow(size_t cell, std::map<std::pair<T, size_t>, S>& chain,
+                      const std::vector<size_t>& rows, SparseColumn<S>& column) const;
+            template<typename F>
+            void parallel(size_t count, F f) const;
+    };
+
+    template<typename T>
+    MorseComplex<T>::MorseComplex(const CubicalComplex<T>& complex, unsigned int threads)
+    : m_Complex(complex), m_Threads(std::max(threads, 1u))
+    {
+        CUBICAL_STATS_SCOPE("morse matching", -1);
+        match();
+    }
+
+    template<typename T>
+    MorseComplex<T>::~MorseComplex()
+    {
+
+    }
+
+    template<typename T>
+    size_t MorseComplex<T>::getCriticalCells() const
+    {
+        size_t count = 0;
+        for(size_t d = 0; d < m_Critical.size(); d++)
+        {
+            count += m_Critical[d].size();
+        }
+        return count;
+    }
+
+    //  runs f(begin, end) over a few blocks per thread
+    template<typename T>
+    template<typename F>
+    void MorseComplex<T>::parallel(size_t count, F f) const
+    {
+        if(m_Threads == 1 || count == 0)
+        {
+            f((size_t)0, count);
+            return;
+        }
+        size_t blocks = std::min(count, (size_t)m_Threads * 4);
+        std::atomic<size_t> next(0);
+        std::vector<std::thread> workers;
+        for(unsigned int t = 0; t < m_Threads; t++)
+        {
+            workers.push_back(std::thread([&]()
+            {
+                for(size_t block = next++; block < blocks; block = next++)
+                {
+                    f(count * block / blocks, count * (block + 1) / blocks);
+                }
+            }));
+        }
+        for(unsigned int t = 0; t < m_Threads; t++)
+        {
+            workers[t].join();
+        }
+    }
+
+    template<typename T>
+    size_t MorseComplex<T>::getYoungestFace(size_t cell) const
+    {
+        size_t faces[64];
+        unsigned int count = 2 * m_Complex.getFaces(cell, faces);
+        if(count == 0)
+        {
+            return cell;
+        }
+        size_t youngest = faces[0];
+        for(unsigned int k = 1; k < count; k++)
+        {
+            if(isOlder(youngest, faces[k]))
+            {
+                youngest = faces[k];
+            }
+        }
+        return youngest;
+    }
+
+    template<typename T>
+    size_t MorseComplex<T>::getOldestCoface(size_t cell) const
+    {
+        size_t cofaces[64];
+        unsigned int count = m_Complex.getCofaces(cell, cofaces);
+        if(count == 0)
+        {
+            return cell;
+        }
+        size_t oldest = cofaces[0];
+        for(unsigned int k = 1; k < count; k++)
+        {
+            if(isOlder(cofaces[k], oldest))
+            {
+                oldest = cofaces[k];
+            }
+        }
+        return oldest;
+    }
+
+    //  the same test seen from either cell of a pair, so both agree
+    template<typename T>
+    size_t MorseComplex<T>::findPartner(size_t cell) const
+    {
+        T value = m_Complex.getValue(cell);
+        size_t coface = getOldestCoface(cell);
+        if(coface != cell && m_Complex.getValue(coface) == value && getYoungestFace(coface) == cell)
+        {
+            return coface;
+        }
+        size_t face = getYoungestFace(cell);
+        if(face != cell && m_Complex.getValue(face) == value && getOldestCoface(face) == cell)
+        {
+            return face;
+        }
+        return cell;
+    }
+
+    template<typename T>
+    void MorseComplex<T>::match()
+    {
+        size_t cells = m_Complex.getCells();
+        m_Partner.resize(cells);
+        parallel(cells, [this](size_t begin, size_t end)
+        {
+            for(size_t cell = begin; cell < end; cell++)
+            {
+                m_Partner[cell] = findPartner(cell);
+            }
+        });
+        m_Critical.assign(m_Complex.getDim() + 1, std::vector<size_t>());
+        for(size_t cell = 0; cell < cells; cell++)
+        {
+            if(m_Partner[cell] == cell)
+            {
+                m_Critical[m_Complex.getCellDimension(cell)].push_back(cell);
+            }
+        }
+        for(size_t d = 0; d < m_Critical.size(); d++)
+        {
+            std::sort(m_Critical[d].begin(), m_Critical[d].end(), [this](size_t a, size_t b) { return isOlder(a, b); });
+        }
+    }
+
+    //  Follows the gradient paths from the chain of (dim - 1)-cells. The
+    //  youngest cell is taken each time, a critical one goes to the column,
+    //  one matched with a face ends its paths and one matched with a coface
+    //  τ is cancelled by subtracting the boundary of τ, whose other faces
+    //  are all older, so the paths end.
+    template<typename T>
+    template<typename S>
+    void MorseComplex<T>::flow(size_t cell, std::map<std::pair<T, size_t>, S>& chain,
+                               const std::vector<size_t>& rows, SparseColumn<S>& column) const
+    {
+        size_t faces[64];
+        int signs[64];
+        std::vector<std::pair<unsigned int, S> > entries;
+        chain.clear();
+        unsigned int count = 2 * m_Complex.getFaces(cell, faces, signs);
+        for(unsigned int k = 0; k < count; k++)
+        {
+            chain[std::make_pair(m_Complex.getValue(faces[k]), faces[k])] += S(signs[k]);
+        }
+        while(!chain.empty())
+        {
+            auto last = std::prev(chain.end());
+            size_t face = last->first.second;
+            S value = last->second;
+            chain.erase(last);
+            if(value == S())
+            {
+                continue;
+            }
+            size_t partner = m_Partner[face];
+            if(partner == face)
+            {
+                auto it = std::lower_bound(rows.begin(), rows.end(), face, [this](size_t a, size_t b) { return isOlder(a, b); });
+                entries.push_back(std::make_pair((unsigned int)(it - rows.begin()), value));
+                continue;
+            }
+            if(m_Complex.getCellDimension(partner) < m_Complex.getCellDimension(face))
+            {
+                continue;
+            }
+            //  chain -= value / [partner : face] * boundary(partner)
+            size_t others[64];
+            int otherSigns[64];
+            unsigned int n = 2 * m_Complex.getFaces(partner, others, otherSigns);
+            int incidence = 0;
+            for(unsigned int k = 0; k < n; k++)
+            {
+                if(others[k] == face)
+                {
+                    incidence = otherSigns[k];
+                }
+            }
+            for(unsigned int k = 0; k < n; k++)
+            {
+                if(others[k] != face)
+                {
+                    chain[std::make_pair(m_Complex.getValue(others[k]), others[k])] -= value * S(incidence * otherSigns[k]);
+                }
+            }
+        }
+        //  entries come youngest first
+        std::sort(entries.begin(), entries.end(), [](const std::pair<unsigned int, S>& a, const std::pair<unsigned int, S>& b)
+        {
+            return a.first < b.first;
+        });
+        column.clear();
+        for(size_t k = 0; k < entries.size(); k++)
+        {
+            if(k + 1 < entries.size() && entries[k].first == entries[k + 1].first)
+            {
+                entries[k + 1].second += entries[k].second;
+                continue;
+            }
+            if(entries[k].second != S())
+            {
+                column.append(entries[k].first, entries[k].second);
+            }
+        }
+    }
+
+    template<typename T>
+    template<typename S>
+    SparseMatrix<S> MorseComplex<T>::getBoundary(unsigned int dim) const
+    {
+        if(dim == 0 || dim >= m_Critical.size())
+        {
+            unsigned int rows = dim == 0 || dim > m_Critical.size() ? 0 : m_Critical[dim - 1].size();
+            unsigned int columns = dim < m_Critical.size() ? m_Critical[dim].size() : 0;
+            return SparseMatrix<S>(rows, columns);
+        }
+        CUBICAL_STATS_SCOPE("morse boundary", (int)dim);
+        const std::vector<size_t>& rows = m_Critical[dim - 1];
+        const std::vector<size_t>& columns = m_Critical[dim];
+        SparseMatrix<S> boundary(rows.size(), columns.size());
+        parallel(columns.size(), [&](size_t begin, size_t end)
+        {
+            std::map<std::pair<T, size_t>, S> chain;
+            for(size_t j = begin; j < end; j++)
+            {
+                flow(columns[j], chain, rows, boundary.getColumn(j));
+            }
+        });
+        return boundary;
+    }
+
+    //  reduces the Morse boundaries from the top dimension down with
+    //  clearing, critical cells of a dimension being in filtration order
+    template<typename T>
+    std::vector<PersistencePair<T> > MorseComplex<T>::getPersistence() const
+    {
+        std::vector<PersistencePair<T> > pairs;
+        std::vector<PersistencePair<T> > essential;
+        unsigned int top = m_Critical.size() - 1;
+        //  critical cells of dimension d + 1 killing each critical d-cell
+        std::vector<bool> cleared;
+        for(int d = top; d >= 0; d--)
+        {
+            const std::vector<size_t>& columns = m_Critical[d];
+            std::vector<bool> negative(columns.size(), false);
+            std::vector<bool> paired(d > 0 ? m_Critical[d - 1].size() : 0, false);
+            if(d > 0)
+            {
+                SparseMatrix<Z2> boundary = getBoundary<Z2>(d);
+                std::vector<unsigned int> pivots(m_Critical[d - 1].size(), std::numeric_limits<unsigned int>::max());
+                for(unsigned int j = 0; j < columns.size(); j++)
+                {
+                    SparseColumn<Z2>& column = boundary.getColumn(j);
+                    if(!cleared.empty() && cleared[j])
+                    {
+                        column.clear();
+                        continue;
+                    }
+                    while(!column.isEmpty())
+                    {
+                        unsigned int k = pivots[column.getPivot()];
+                        if(k == std::numeric_limits<unsigned int>::max())
+                        {
+                            break;
+                        }
+                        boundary.columnAdd(j, k, Z2(1));
+                    }
+                    if(column.isEmpty())
+                    {
+                        continue;
+                    }
+                    unsigned int i = column.getPivot();
+                    pivots[i] = j;
+                    paired[i] = true;
+                    negative[j] = true;
+                    size_t birth = m_Critical[d - 1][i];
+                    size_t death = columns[j];
+                    if(m_Complex.getValue(birth) < m_Complex.getValue(death))
+                    {
+                        PersistencePair<T> pair = { (unsigned int)(d - 1), m_Complex.getValue(birth), m_Complex.getValue(death), false };
+                        pairs.push_back(pair);
+                    }
+                }
+            }
+            //  columns neither killing nor killed are essential
+            for(unsigned int j = 0; j < columns.size(); j++)
+            {
+                if(!negative[j] && (cleared.empty() || !cleared[j]))
+                {
+                    PersistencePair<T> pair = { (unsigned int)d, m_Complex.getValue(columns[j]), std::numeric_limits<T>::max(), true };
+                    essential.push_back(pair);
+                }
+            }
+            cleared.swap(paired);
+        }
+        pairs.insert(pairs.end(), essential.begin(), essential.end());
+        return pairs;
+    }
+
+    template<typename T>
+    void MorseComplex<T>::print()
+    {
+        std::cout << m_Complex.getCells() << " cells, " << getCriticalCells() << " critical\n";
+        for(size_t d = 0; d < m_Critical.size(); d++)
+        {
+            std::cout << "  dimension " << d << ": " << m_Critical[d].size() << "\n";
+        }
+    }
+
+}
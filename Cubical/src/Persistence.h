@@ -0,0 +1,508 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <limits>
+#include <thread>
+#include <atomic>
+#include <unordered_map>
+#include <memory>
+
+#include "Allocator.h"
+#include "Stats.h"
+#include "CubicalComplex.h"
+#include "SparseMatrix.h"
+#include "Z2.h"
+
+namespace Cubical
+{
+    //  a class born at birth and killed at death in dimension dim,
+    //  essential classes never die and have death set to the maximum
+    template<typename T>
+    struct PersistencePair
+    {
+        unsigned int dim;
+        T birth;
+        T death;
+        bool essential;
+    };
+
+    //  Persistence of the sublevel filtration of a cubical complex over
+    //  Z/2. Cells are ordered by value, then dimension, then index, and the
+    //  boundary matrix in that order is reduced by the standard column
+    //  algorithm. Columns are generated from the implicit cell structure
+    //  as they are reached, so only reduced columns are stored. Additions
+    //  never mix dimensions, so the columns are reduced one dimension at a
+    //  time, which also releases each dimension once it is done.
+    //
+    //  With clearing, dimensions are reduced from the top down and the
+    //  column of every pivot row is skipped, since it must reduce to zero.
+    //  With cohomology, the anti-transposed coboundary matrix is reduced
+    //  instead, from the bottom dimension up, which pairs the same cells.
+    //
+    //  With several threads, the columns of each pass are split into
+    //  chunks which are reduced concurrently against the pivots of their
+    //  own chunk only. A sequential merge then finishes the columns in
+    //  order against the global pivots. Every addition is still of an
+    //  earlier column into a later one, so the pairs do not depend on the
+    //  number of threads.
+    //
+    //  With apparent pairs, a column whose youngest face has the column's
+    //  cell as its oldest coface is paired with that face straight away,
+    //  since no earlier column can reach the same pivot. Such a column is
+    //  already reduced, so it is neither generated nor stored, and is
+    //  regenerated from the cell structure whenever a later column needs
+    //  to add it. In cohomology the roles of faces and cofaces swap.
+    //
+    //  Column buffers come from one Pool per thread. The columns of a
+    //  pass are never read by later passes, so they are dropped and the
+    //  pools released in bulk at the end of each pass.
+    template<typename T>
+    class Persistence
+    {
+        public:
+            Persistence<T>(const CubicalComplex<T>& complex, bool clearing = true, bool cohomology = false,
+                           unsigned int threads = 1, bool apparent = true);
+            virtual ~Persistence<T>();
+
+            //  getters and setters
+            //  pairs of non-zero persistence followed by essential classes
+            const std::vector<PersistencePair<T> >& getPairs() const { return m_Pairs; }
+            //  number of columns paired without being generated or reduced
+            size_t getApparentPairs() const { return m_ApparentPairs; }
+
+            void print();
+
+        private:
+            typedef PoolAllocator<Z2> ColumnAllocator;
+            typedef SparseColumn<Z2, ColumnAllocator> Column;
+
+            const CubicalComplex<T>& m_Complex;
+            bool m_Clearing;
+            bool m_Cohomology;
+            unsigned int m_Threads;
+            bool m_Apparent;
+            //  cells in filtration order, position and dimension of each
+            std::vector<unsigned int> m_Order;
+            std::vector<unsigned int> m_Position;
+            std::vector<unsigned char> m_Dims;
+            //  column storage of each thread, outlives the columns
+            std::vector<std::unique_ptr<Pool> > m_Pools;
+            //  reduced columns and the column owning each pivot row
+            SparseMatrix<Z2, ColumnAllocator> m_Reduced;
+            std::vector<unsigned int> m_Pivots;
+            std::vector<bool> m_Paired;
+            //  pivot row of each column found apparent, or the maximum
+            std::vector<unsigned int> m_ApparentPivots;
+            size_t m_ApparentPairs;
+            std::vector<PersistencePair<T> > m_Pairs;
+
+            //  cell of column j
+            unsigned int getCell(unsigned int j) const
+            {
+                return m_Order[m_Cohomology ? m_Order.size() - 1 - j : j];
+            }
+            void sortCells();
+            void generateColumn(unsigned int j, Column& column, Pool* pool) const;
+            //  pivot row if column j is part of an apparent pair, else the maximum
+            unsigned int findApparent(unsigned int j) const;
+            void addApparent(unsigned int i, unsigned int j);
+            void reduceColumn(unsigned int j);
+            //  adds column k to column j, counted in CUBICAL_STATS builds
+            void addColumn(unsigned int j, unsigned int k, Pool* pool);
+            void finishColumn(unsigned int j);
+            void reduceChunk(const std::vector<unsigned int>& columns, size_t begin, size_t end, Pool* pool);
+            void reduceColumns(const std::vector<unsigned int>& columns);
+            void releaseColumns(const std::vector<unsigned int>& columns);
+            void reduce();
+            void addPair(unsigned int i, unsigned int j);
+    };
+
+    template<typename T>
+    Persistence<T>::Persistence(const CubicalComplex<T>& complex, bool clearing, bool cohomology, unsigned int threads,
+                                bool apparent)
+    : m_Complex(complex), m_Clearing(clearing), m_Cohomology(cohomology), m_Threads(std::max(threads, 1u)),
+      m_Apparent(apparent), m_ApparentPairs(0)
+    {
+        CUBICAL_STATS_SCOPE("persistence", -1);
+        {
+            CUBICAL_STATS_SCOPE("sort cells", -1);
+            sortCells();
+        }
+        reduce();
+    }
+
+    template<typename T>
+    Persistence<T>::~Persistence()
+    {
+
+    }
+
+    template<typename T>
+    void Persistence<T>::sortCells()
+    {
+        unsigned int cells = m_Complex.getCells();
+        m_Dims.resize(cells);
+        m_Order.resize(cells);
+        for(unsigned int cell = 0; cell < cells; cell++)
+        {
+            m_Dims[cell] = m_Complex.getCellDimension(cell);
+            m_Order[cell] = cell;
+        }
+        std::sort(m_Order.begin(), m_Order.end(), [this](unsigned int a, unsigned int b)
+        {
+            T va = m_Complex.getValue(a);
+            T vb = m_Complex.getValue(b);
+            if(va != vb)
+            {
+                return va < vb;
+            }
+            if(m_Dims[a] != m_Dims[b])
+            {
+                return m_Dims[a] < m_Dims[b];
+            }
+            return a < b;
+        });
+        m_Position.resize(cells);
+        for(unsigned int p = 0; p < cells; p++)
+        {
+            m_Position[m_Order[p]] = p;
+        }
+    }
+
+    template<typename T>
+    void Persistence<T>::generateColumn(unsigned int j, Column& column, Pool* pool) const
+    {
+        //  a cell has at most 2 * dim faces or cofaces
+        size_t cells[64];
+        unsigned int count = 0;
+        if(m_Cohomology)
+        {
+            count = m_Complex.getCofaces(getCell(j), cells);
+        }
+        else
+        {
+            count = 2 * m_Complex.getFaces(getCell(j), cells);
+        }
+        unsigned int rows[64];
+        for(unsigned int k = 0; k < count; k++)
+        {
+            unsigned int p = m_Position[cells[k]];
+            rows[k] = m_Cohomology ? m_Order.size() - 1 - p : p;
+        }
+        std::sort(rows, rows + count);
+        column = Column(ColumnAllocator(pool));
+        for(unsigned int k = 0; k < count; k++)
+        {
+            column.append(rows[k], Z2(1));
+        }
+    }
+
+    //  In homology the pivot of column j is the youngest face of its cell,
+    //  and the pair is apparent when the cell is the oldest coface of that
+    //  face. In cohomology the pivot is the oldest coface and the cell must
+    //  be its youngest face. Both only read the complex, so columns may be
+    //  tested concurrently.
+    template<typename T>
+    unsigned int Persistence<T>::findApparent(unsigned int j) const
+    {
+        const unsigned int none = std::numeric_limits<unsigned int>::max();
+        size_t cells[64];
+        unsigned int cell = getCell(j);
+        unsigned int count = 0;
+        size_t partner = 0;
+        if(m_Cohomology)
+        {
+            count = m_Complex.getCofaces(cell, cells);
+            if(count == 0)
+            {
+                return none;
+            }
+            partner = cells[0];
+            for(unsigned int k = 1; k < count; k++)
+            {
+                if(m_Position[cells[k]] < m_Position[partner])
+                {
+                    partner = cells[k];
+                }
+            }
+            count = 2 * m_Complex.getFaces(partner, cells);
+            for(unsigned int k = 0; k < count; k++)
+            {
+                if(m_Position[cells[k]] > m_Position[cell])
+                {
+                    return none;
+                }
+            }
+            return m_Order.size() - 1 - m_Position[partner];
+        }
+        count = 2 * m_Complex.getFaces(cell, cells);
+        if(count == 0)
+        {
+            return none;
+        }
+        partner = cells[0];
+        for(unsigned int k = 1; k < count; k++)
+        {
+            if(m_Position[cells[k]] > m_Position[partner])
+            {
+                partner = cells[k];
+            }
+        }
+        count = m_Complex.getCofaces(partner, cells);
+        for(unsigned int k = 0; k < count; k++)
+        {
+            if(m_Position[cells[k]] < m_Position[cell])
+            {
+                return none;
+            }
+        }
+        return m_Position[partner];
+    }
+
+    template<typename T>
+    void Persistence<T>::addApparent(unsigned int i, unsigned int j)
+    {
+        m_Pivots[i] = j;
+        m_ApparentPivots[j] = i;
+        m_ApparentPairs++;
+        CUBICAL_STATS_ADD(apparentPairs, 1);
+        addPair(i, j);
+    }
+
+    template<typename T>
+    void Persistence<T>::reduceColumn(unsigned int j)
+    {
+        if(m_Apparent)
+        {
+            unsigned int pivot = findApparent(j);
+            if(pivot != std::numeric_limits<unsigned int>::max())
+            {
+                addApparent(pivot, j);
+                return;
+            }
+        }
+        generateColumn(j, m_Reduced.getColumn(j), m_Pools[0].get());
+        finishColumn(j);
+    }
+
+    //  an apparent column is not stored and is regenerated for the addition
+    template<typename T>
+    void Persistence<T>::addColumn(unsigned int j, unsigned int k, Pool* pool)
+    {
+        Column& column = m_Reduced.getColumn(j);
+#ifdef CUBICAL_STATS
+        size_t before = column.getNonZeros();
+#endif
+        if(m_ApparentPivots[k] != std::numeric_limits<unsigned int>::max())
+        {
+            Column boundary;
+            generateColumn(k, boundary, pool);
+            column.add(boundary, Z2(1));
+        }
+        else
+        {
+            m_Reduced.columnAdd(j, k, Z2(1));
+        }
+#ifdef CUBICAL_STATS
+        size_t after = column.getNonZeros();
+        CUBICAL_STATS_ADD(columnAdds, 1);
+        CUBICAL_STATS_ADD(fillIn, (int64_t)after - (int64_t)before);
+        CUBICAL_STATS_MAX(maxColumn, after);
+#endif
+    }
+
+    template<typename T>
+    void Persistence<T>::finishColumn(unsigned int j)
+    {
+        Column& column = m_Reduced.getColumn(j);
+        while(!column.isEmpty())
+        {
+            unsigned int pivot = column.getPivot();
+            unsigned int k = m_Pivots[pivot];
+            CUBICAL_STATS_ADD(pivotLookups, 1);
+            if(k == std::numeric_limits<unsigned int>::max())
+            {
+                m_Pivots[pivot] = j;
+                addPair(pivot, j);
+                return;
+            }
+            addColumn(j, k, m_Pools[0].get());
+        }
+    }
+
+    //  local reduction of columns[begin, end), only columns of the
+    //  same chunk are added so chunks touch disjoint columns
+    template<typename T>
+    void Persistence<T>::reduceChunk(const std::vector<unsigned int>& columns, size_t begin, size_t end, Pool* pool)
+    {
+        std::unordered_map<unsigned int, unsigned int> pivots;
+        for(size_t c = begin; c < end; c++)
+        {
+            unsigned int j = columns[c];
+            if(m_Apparent)
+            {
+                //  marked here, paired in order by the merge
+                unsigned int pivot = findApparent(j);
+                if(pivot != std::numeric_limits<unsigned int>::max())
+                {
+                    m_ApparentPivots[j] = pivot;
+                    pivots[pivot] = j;
+                    continue;
+                }
+            }
+            Column& column = m_Reduced.getColumn(j);
+            generateColumn(j, column, pool);
+            while(!column.isEmpty())
+            {
+                auto it = pivots.find(column.getPivot());
+                CUBICAL_STATS_ADD(pivotLookups, 1);
+                if(it == pivots.end())
+                {
+                    pivots[column.getPivot()] = j;
+                    break;
+                }
+                addColumn(j, it->second, pool);
+            }
+        }
+    }
+
+    template<typename T>
+    void Persistence<T>::reduceColumns(const std::vector<unsigned int>& columns)
+    {
+        if(m_Threads == 1)
+        {
+            for(size_t c = 0; c < columns.size(); c++)
+            {
+                reduceColumn(columns[c]);
+            }
+            return;
+        }
+        //  a few chunks per thread balances uneven columns
+        size_t chunks = std::min(columns.size(), (size_t)m_Threads * 4);
+        std::atomic<size_t> next(0);
+        std::vector<std::thread> workers;
+        for(unsigned int t = 0; t < m_Threads; t++)
+        {
+            Pool* pool = m_Pools[t].get();
+            workers.push_back(std::thread([&, pool]()
+            {
+                for(size_t chunk = next++; chunk < chunks; chunk = next++)
+                {
+                    CUBICAL_STATS_SCOPE("reduce chunk", -1);
+                    reduceChunk(columns, columns.size() * chunk / chunks, columns.size() * (chunk + 1) / chunks, pool);
+                }
+            }));
+        }
+        for(unsigned int t = 0; t < m_Threads; t++)
+        {
+            workers[t].join();
+        }
+        for(size_t c = 0; c < columns.size(); c++)
+        {
+            unsigned int j = columns[c];
+            if(m_ApparentPivots[j] != std::numeric_limits<unsigned int>::max())
+            {
+                addApparent(m_ApparentPivots[j], j);
+            }
+            else
+            {
+                finishColumn(j);
+            }
+        }
+    }
+
+    template<typename T>
+    void Persistence<T>::reduce()
+    {
+        unsigned int cells = m_Order.size();
+        m_Pools.clear();
+        for(unsigned int t = 0; t < m_Threads; t++)
+        {
+            m_Pools.push_back(std::unique_ptr<Pool>(new Pool()));
+        }
+        m_Reduced = SparseMatrix<Z2, ColumnAllocator>(cells, cells);
+        m_Pivots.assign(cells, std::numeric_limits<unsigned int>::max());
+        m_Paired.assign(cells, false);
+        m_ApparentPivots.assign(cells, std::numeric_limits<unsigned int>::max());
+        m_ApparentPairs = 0;
+        std::vector<unsigned int> columns;
+        //  homology clears downwards, cohomology upwards, and without
+        //  clearing the same passes time each dimension on its own
+        unsigned int top = m_Complex.getDim();
+        for(unsigned int d = 0; d <= top; d++)
+        {
+            unsigned int dim = m_Cohomology ? d : top - d;
+            CUBICAL_STATS_SCOPE("reduce dimension", (int)dim);
+            columns.clear();
+            for(unsigned int j = 0; j < cells; j++)
+            {
+                if(m_Dims[getCell(j)] == dim && !(m_Clearing && m_Paired[j]))
+                {
+                    columns.push_back(j);
+                }
+            }
+            reduceColumns(columns);
+            releaseColumns(columns);
+        }
+        for(unsigned int j = 0; j < cells; j++)
+        {
+            if(!m_Paired[j])
+            {
+                unsigned int cell = getCell(j);
+                PersistencePair<T> pair = { m_Dims[cell], m_Complex.getValue(cell), std::numeric_limits<T>::max(), true };
+                m_Pairs.push_back(pair);
+            }
+        }
+    }
+
+    //  the columns of a finished pass are never added again
+    template<typename T>
+    void Persistence<T>::releaseColumns(const std::vector<unsigned int>& columns)
+    {
+        for(size_t c = 0; c < columns.size(); c++)
+        {
+            m_Reduced.getColumn(columns[c]) = Column();
+        }
+        for(unsigned int t = 0; t < m_Threads; t++)
+        {
+            m_Pools[t]->release();
+        }
+    }
+
+    //  pairs pivot row i with column j, in cohomology the column
+    //  holds the birth cell and the row the death cell
+    template<typename T>
+    void Persistence<T>::addPair(unsigned int i, unsigned int j)
+    {
+        m_Paired[i] = true;
+        m_Paired[j] = true;
+        unsigned int birth = m_Cohomology ? getCell(j) : getCell(i);
+        unsigned int death = m_Cohomology ? getCell(i) : getCell(j);
+        if(m_Complex.getValue(birth) < m_Complex.getValue(death))
+        {
+            PersistencePair<T> pair = { m_Dims[birth], m_Complex.getValue(birth), m_Complex.getValue(death), false };
+            m_Pairs.push_back(pair);
+        }
+    }
+
+    template<typename T>
+    void Persistence<T>::print()
+    {
+        for(unsigned int k = 0; k < m_Pairs.size(); k++)
+        {
+            std::cout << m_Pairs[k].dim << ": [" << +m_Pairs[k].birth << ", ";
+            if(m_Pairs[k].essential)
+            {
+                std::cout << "inf)\n";
+            }
+            else
+            {
+                std::cout << +m_Pairs[k].death << ")\n";
+            }
+        }
+    }
+
+}
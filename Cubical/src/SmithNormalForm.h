@@ -0,0 +1,400 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+
+#include "Matrix.h"
+#include "BitMatrix.h"
+#include "Z2.h"
+
+namespace Cubical
+{
+    //  size of an entry used to choose pivots, the absolute
+    //  value for ordered types and one for any non-zero Z/2 entry
+    template<typename T>
+    T snfMagnitude(const T value) { return value < T() ? -value : value; }
+    inline int snfMagnitude(const Z2 value) { return value.getValue(); }
+    //  unit normalizing a diagonal entry, -1 for negative entries of
+    //  ordered types, fields such as ModP use the inverse
+    template<typename T>
+    T snfUnit(const T value) { return value < T() ? T(-1) : T(1); }
+    inline Z2 snfUnit(const Z2) { return Z2(1); }
+
+    //  Betti numbers and torsion coefficients of a chain complex
+    template<typename T>
+    struct Homology
+    {
+        std::vector<unsigned int> betti;
+        std::vector<std::vector<T> > torsion;
+    };
+
+    //  reduces a matrix in place to Smith normal form using only
+    //  its elementary row and column operations; optionally records
+    //  the transformations so that rows * A * columns = D
+    template<typename T>
+    class SmithNormalForm
+    {
+        public:
+            SmithNormalForm<T>(Matrix<T>& mat, Matrix<T>* rows = nullptr, Matrix<T>* columns = nullptr);
+            virtual ~SmithNormalForm<T>();
+
+            //  getters and setters
+            unsigned int getRank() const { return m_Diagonal.size(); }
+            const std::vector<T>& getDiagonal() const { return m_Diagonal; }
+
+        private:
+            //  reduced matrix and optional transformations
+            Matrix<T>& m_Mat;
+            Matrix<T>* m_Rows;
+            Matrix<T>* m_Columns;
+            //  non-zero diagonal entries
+            std::vector<T> m_Diagonal;
+
+            void reduce();
+            bool selectPivot(unsigned int t);
+            void moveToPivot(unsigned int t, unsigned int i, unsigned int j);
+            bool eliminate(unsigned int t);
+            bool divides(unsigned int t);
+
+            //  elementary operations mirrored onto the transformations
+            void rowExchange(unsigned int i, unsigned int j);
+            void rowAdd(unsigned int i, unsigned int j, const T value);
+            void rowMultiply(unsigned int i, const T value);
+            void columnExchange(unsigned int i, unsigned int j);
+            void columnAdd(unsigned int i, unsigned int j, const T value);
+    };
+
+    template<typename T>
+    SmithNormalForm<T>::SmithNormalForm(Matrix<T>& mat, Matrix<T>* rows, Matrix<T>* columns)
+    : m_Mat(mat), m_Rows(rows), m_Columns(columns)
+    {
+        if(m_Rows)
+        {
+            *m_Rows = Matrix<T>(m_Mat.getN(), m_Mat.getN());
+            for(unsigned int i = 0; i < m_Mat.getN(); i++)
+            {
+                (*m_Rows)(i,i) = T(1);
+            }
+        }
+        if(m_Columns)
+        {
+            *m_Columns = Matrix<T>(m_Mat.getM(), m_Mat.getM());
+            for(unsigned int j = 0; j < m_Mat.getM(); j++)
+            {
+                (*m_Columns)(j,j) = T(1);
+            }
+        }
+        reduce();
+    }
+
+    template<typename T>
+    SmithNormalForm<T>::~SmithNormalForm()
+    {
+
+    }
+
+    template<typename T>
+    void SmithNormalForm<T>::reduce()
+    {
+        unsigned int size = std::min(m_Mat.getN(), m_Mat.getM());
+        for(unsigned int t = 0; t < size; t++)
+        {
+            if(!selectPivot(t))
+            {
+                return;
+            }
+            //  repeat until row and column t are clear and
+            //  the pivot divides the remaining submatrix
+            while(!eliminate(t) || !divides(t))
+            {
+
+            }
+            T unit = snfUnit(m_Mat(t,t));
+            if(unit != T(1))
+            {
+                rowMultiply(t, unit);
+            }
+            m_Diagonal.push_back(m_Mat(t,t));
+        }
+    }
+
+    //  Chooses the non-zero entry of the trailing submatrix with the
+    //  smallest magnitude, breaking ties by the Markowitz count
+    //  (r - 1)(c - 1) of its row and column, which bounds the fill-in
+    //  produced by eliminating it.
+    template<typename T>
+    bool SmithNormalForm<T>::selectPivot(unsigned int t)
+    {
+        unsigned int n = m_Mat.getN();
+        unsigned int m = m_Mat.getM();
+        std::vector<unsigned int> rowCount(n, 0);
+        std::vector<unsigned int> columnCount(m, 0);
+        for(unsigned int i = t; i < n; i++)
+        {
+            for(unsigned int j = t; j < m; j++)
+            {
+                if(m_Mat(i,j) != T())
+                {
+                    rowCount[i]++;
+                    columnCount[j]++;
+                }
+            }
+        }
+        bool found = false;
+        unsigned int pi = 0;
+        unsigned int pj = 0;
+        size_t cost = 0;
+        for(unsigned int i = t; i < n; i++)
+        {
+            if(rowCount[i] == 0)
+            {
+                continue;
+            }
+            for(unsigned int j = t; j < m; j++)
+            {
+                T value = m_Mat(i,j);
+                if(value == T())
+                {
+                    continue;
+                }
+                size_t temp = (size_t)(rowCount[i] - 1) * (columnCount[j] - 1);
+                if(!found || snfMagnitude(value) < snfMagnitude(m_Mat(pi,pj))
+                   || (!(snfMagnitude(m_Mat(pi,pj)) < snfMagnitude(value)) && temp < cost))
+                {
+                    found = true;
+                    pi = i;
+                    pj = j;
+                    cost = temp;
+                }
+            }
+        }
+        if(found)
+        {
+            moveToPivot(t, pi, pj);
+        }
+        return found;
+    }
+
+    template<typename T>
+    void SmithNormalForm<T>::moveToPivot(unsigned int t, unsigned int i, unsigned int j)
+    {
+        if(i != t)
+        {
+            rowExchange(t, i);
+        }
+        if(j != t)
+        {
+            columnExchange(t, j);
+        }
+    }
+
+    //  Clears row and column t with the pivot, returns false when a
+    //  remainder is left, after moving the smallest one to the pivot.
+    template<typename T>
+    bool SmithNormalForm<T>::eliminate(unsigned int t)
+    {
+        const T pivot = m_Mat(t,t);
+        bool clear = true;
+        unsigned int bi = t;
+        unsigned int bj = t;
+        for(unsigned int i = t + 1; i < m_Mat.getN(); i++)
+        {
+            T value = m_Mat(i,t);
+            if(value == T())
+            {
+                continue;
+            }
+            rowAdd(i, t, -(value / pivot));
+            value = m_Mat(i,t);
+            if(value != T())
+            {
+                if(clear || snfMagnitude(value) < snfMagnitude(m_Mat(bi,bj)))
+                {
+                    bi = i;
+                    bj = t;
+                }
+                clear = false;
+            }
+        }
+        for(unsigned int j = t + 1; j < m_Mat.getM(); j++)
+        {
+            T value = m_Mat(t,j);
+            if(value == T())
+            {
+                continue;
+            }
+            columnAdd(j, t, -(value / pivot));
+            value = m_Mat(t,j);
+            if(value != T())
+            {
+                if(clear || snfMagnitude(value) < snfMagnitude(m_Mat(bi,bj)))
+                {
+                    bi = t;
+                    bj = j;
+                }
+                clear = false;
+            }
+        }
+        if(!clear)
+        {
+            moveToPivot(t, bi, bj);
+        }
+        return clear;
+    }
+
+    //  Checks that the pivot divides every entry of the trailing
+    //  submatrix, otherwise adds the offending row into row t.
+    template<typename T>
+    bool SmithNormalForm<T>::divides(unsigned int t)
+    {
+        const T pivot = m_Mat(t,t);
+        for(unsigned int i = t + 1; i < m_Mat.getN(); i++)
+        {
+            for(unsigned int j = t + 1; j < m_Mat.getM(); j++)
+            {
+                T value = m_Mat(i,j);
+                if(value != T() && value - (value / pivot) * pivot != T())
+                {
+                    rowAdd(t, i, T(1));
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    template<typename T>
+    void SmithNormalForm<T>::rowExchange(unsigned int i, unsigned int j)
+    {
+        m_Mat.rowExchange(i, j);
+        if(m_Rows)
+        {
+            m_Rows->rowExchange(i, j);
+        }
+    }
+
+    template<typename T>
+    void SmithNormalForm<T>::rowAdd(unsigned int i, unsigned int j, const T value)
+    {
+        m_Mat.rowAdd(i, j, value);
+        if(m_Rows)
+        {
+            m_Rows->rowAdd(i, j, value);
+        }
+    }
+
+    template<typename T>
+    void SmithNormalForm<T>::rowMultiply(unsigned int i, const T value)
+    {
+        m_Mat.rowMultiply(i, value);
+        if(m_Rows)
+        {
+            m_Rows->rowMultiply(i, value);
+        }
+    }
+
+    template<typename T>
+    void SmithNormalForm<T>::columnExchange(unsigned int i, unsigned int j)
+    {
+        m_Mat.columnExchange(i, j);
+        if(m_Columns)
+        {
+            m_Columns->columnExchange(i, j);
+        }
+    }
+
+    template<typename T>
+    void SmithNormalForm<T>::columnAdd(unsigned int i, unsigned int j, const T value)
+    {
+        m_Mat.columnAdd(i, j, value);
+        if(m_Columns)
+        {
+            m_Columns->columnAdd(i, j, value);
+        }
+    }
+
+    //  Homology of the chain complex whose k-th matrix is the boundary
+    //  C_{k+1} -> C_k, so boundaries[0] has one row per vertex. The
+    //  matrices are reduced in place.
+    template<typename T>
+    Homology<T> computeHomology(std::vector<Matrix<T> >& boundaries)
+    {
+        Homology<T> homology;
+        if(boundaries.empty())
+        {
+            return homology;
+        }
+        unsigned int size = boundaries.size();
+        std::vector<unsigned int> ranks(size);
+        std::vector<std::vector<T> > diagonals(size);
+        for(unsigned int k = 0; k < size; k++)
+        {
+            if(k > 0 && boundaries[k].getN() != boundaries[k - 1].getM())
+            {
+                std::cout << "ERROR! Boundary matrices " << k - 1 << " and " << k << " are not compatible!" << std::endl;
+                return homology;
+            }
+            SmithNormalForm<T> snf(boundaries[k]);
+            ranks[k] = snf.getRank();
+            diagonals[k] = snf.getDiagonal();
+        }
+        //  b_k = dim C_k - rank d_k - rank d_{k+1}
+        for(unsigned int k = 0; k <= size; k++)
+        {
+            unsigned int cells = (k == 0) ? boundaries[0].getN() : boundaries[k - 1].getM();
+            unsigned int lower = (k == 0) ? 0 : ranks[k - 1];
+            unsigned int upper = (k == size) ? 0 : ranks[k];
+            homology.betti.push_back(cells - lower - upper);
+            std::vector<T> torsion;
+            if(k < size)
+            {
+                for(unsigned int i = 0; i < diagonals[k].size(); i++)
+                {
+                    if(1 < snfMagnitude(diagonals[k][i]))
+                    {
+                        torsion.push_back(diagonals[k][i]);
+                    }
+                }
+            }
+            homology.torsion.push_back(torsion);
+        }
+        return homology;
+    }
+
+    //  Homology over Z/2 of a chain complex of packed boundaries, whose
+    //  ranks come from the column reduction of BitMatrix. Column-packed
+    //  boundaries add whole words at a time. The matrices are reduced in
+    //  place, and there is no torsion.
+    template<Layout L>
+    Homology<Z2> computeHomology(std::vector<BitMatrix<L> >& boundaries)
+    {
+        Homology<Z2> homology;
+        if(boundaries.empty())
+        {
+            return homology;
+        }
+        unsigned int size = boundaries.size();
+        std::vector<unsigned int> ranks(size);
+        for(unsigned int k = 0; k < size; k++)
+        {
+            if(k > 0 && boundaries[k].getN() != boundaries[k - 1].getM())
+            {
+                std::cout << "ERROR! Boundary matrices " << k - 1 << " and " << k << " are not compatible!" << std::endl;
+                return homology;
+            }
+            ranks[k] = boundaries[k].reduceColumns();
+        }
+        for(unsigned int k = 0; k <= size; k++)
+        {
+            unsigned int cells = (k == 0) ? boundaries[0].getN() : boundaries[k - 1].getM();
+            unsigned int lower = (k == 0) ? 0 : ranks[k - 1];
+            unsigned int upper = (k == size) ? 0 : ranks[k];
+            homology.betti.push_back(cells - lower - upper);
+            homology.torsion.push_back(std::vector<Z2>());
+        }
+        return homology;
+    }
+
+}
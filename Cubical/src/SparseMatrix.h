@@ -0,0 +1,605 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <iterator>
+#include <memory>
+
+#include "Error.h"
+#include "Matrix.h"
+#include "Z2.h"
+
+namespace Cubical
+{
+    //  takes the contents of a scratch buffer, swapped in when the column
+    //  uses the heap and copied into the column's own storage otherwise,
+    //  so memory of an arena never ends up in a per-thread scratch buffer
+    template<typename U>
+    void takeScratch(std::vector<U>& target, std::vector<U>& scratch)
+    {
+        target.swap(scratch);
+    }
+
+    template<typename U, typename A>
+    void takeScratch(std::vector<U, A>& target, std::vector<U>& scratch)
+    {
+        target.assign(scratch.begin(), scratch.end());
+    }
+
+    //  a single sparse column, stored as a list of
+    //  strictly increasing row indices and their values,
+    //  with storage from Alloc
+    template<typename T, typename Alloc = std::allocator<T> >
+    class SparseColumn
+    {
+        public:
+            typedef typename std::allocator_traits<Alloc>::template rebind_alloc<unsigned int> RowAlloc;
+
+            SparseColumn<T, Alloc>() {}
+            explicit SparseColumn<T, Alloc>(const Alloc& alloc) : m_Rows(RowAlloc(alloc)), m_Values(alloc) {}
+
+            //  getters and setters
+            unsigned int getNonZeros() const { return m_Rows.size(); }
+            bool isEmpty() const { return m_Rows.empty(); }
+            unsigned int getRow(unsigned int k) const { return m_Rows[k]; }
+            T getValue(unsigned int k) const { return m_Values[k]; }
+            //  largest row index, the column must not be empty
+            unsigned int getPivot() const { return m_Rows.back(); }
+
+            //  value at row i
+            T operator()(unsigned int i) const;
+            void set(unsigned int i, const T value);
+            //  append an entry below all stored entries
+            void append(unsigned int i, const T value);
+            void clear();
+            void shrinkToFit() { m_Rows.shrink_to_fit(); m_Values.shrink_to_fit(); }
+
+            //  column operations, other may be this column
+            void multiply(const T value);
+            void add(const SparseColumn<T, Alloc>& other, const T value);
+            void exchangeRows(unsigned int i, unsigned int j);
+
+        private:
+            std::vector<unsigned int, RowAlloc> m_Rows;
+            std::vector<T, Alloc> m_Values;
+    };
+
+    //  over Z/2 every stored entry is one, so only the
+    //  row indices are kept and addition is a symmetric difference
+    template<typename Alloc>
+    class SparseColumn<Z2, Alloc>
+    {
+        public:
+            typedef typename std::allocator_traits<Alloc>::template rebind_alloc<unsigned int> RowAlloc;
+
+            SparseColumn<Z2, Alloc>() {}
+            explicit SparseColumn<Z2, Alloc>(const Alloc& alloc) : m_Rows(RowAlloc(alloc)) {}
+
+            //  getters and setters
+            unsigned int getNonZeros() const { return m_Rows.size(); }
+            bool isEmpty() const { return m_Rows.empty(); }
+            unsigned int getRow(unsigned int k) const { return m_Rows[k]; }
+            Z2 getValue(unsigned int) const { return Z2(1); }
+            //  largest row index, the column must not be empty
+            unsigned int getPivot() const { return m_Rows.back(); }
+
+            //  value at row i
+            Z2 operator()(unsigned int i) const;
+            void set(unsigned int i, const Z2 value);
+            //  append an entry below all stored entries
+            void append(unsigned int i, const Z2 value);
+            void clear() { m_Rows.clear(); }
+            void shrinkToFit() { m_Rows.shrink_to_fit(); }
+
+            //  column operations, other may be this column
+            void multiply(const Z2 value);
+            void add(const SparseColumn<Z2, Alloc>& other, const Z2 value);
+            void exchangeRows(unsigned int i, unsigned int j);
+
+        private:
+            std::vector<unsigned int, RowAlloc> m_Rows;
+    };
+
+    //  sparse matrix stored as a list of columns, memory is
+    //  proportional to the number of non-zero entries
+    template<typename T, typename Alloc = std::allocator<T> >
+    class SparseMatrix
+    {
+        public:
+            SparseMatrix<T, Alloc>();
+            virtual ~SparseMatrix<T, Alloc>();
+            SparseMatrix<T, Alloc>(unsigned int n, unsigned int m, const Alloc& alloc = Alloc());
+            SparseMatrix<T, Alloc>(const Matrix<T>& mat);
+            //  loads a sparse binary matrix file straight into columns,
+            //  dense and text files are read through Matrix
+            SparseMatrix<T, Alloc>(const std::string& filename);
+
+            //  getters and setters
+            unsigned int getN() const { return m_N; }
+            unsigned int getM() const { return m_M; }
+            size_t getNonZeros() const;
+            const SparseColumn<T, Alloc>& getColumn(unsigned int j) const { return m_Columns[j]; }
+            SparseColumn<T, Alloc>& getColumn(unsigned int j) { return m_Columns[j]; }
+
+            //  operator overloads, bounds checked in CUBICAL_CHECKED builds
+            T operator()(unsigned int i, unsigned int j) const;
+            void set(unsigned int i, unsigned int j, const T value);
+
+            //  basic linear algebra
+            void rowExchange(unsigned int i, unsigned int j);
+            void rowMultiply(unsigned int i, const T value);
+            void rowAdd(unsigned int i, unsigned int j, const T value);
+
+            void columnExchange(unsigned int i, unsigned int j);
+            void columnMultiply(unsigned int i, const T value);
+            void columnAdd(unsigned int i, unsigned int j, const T value);
+
+            //  conversion
+            Matrix<T> toDense() const;
+
+            void print();
+            //  writes a sparse binary matrix file
+            bool save(const std::string& filename) const;
+
+        private:
+            //  size
+            unsigned int m_N;
+            unsigned int m_M;
+            //  columns
+            std::vector<SparseColumn<T, Alloc> > m_Columns;
+    };
+
+    template<typename T, typename Alloc>
+    T SparseColumn<T, Alloc>::operator()(unsigned int i) const
+    {
+        auto it = std::lower_bound(m_Rows.begin(), m_Rows.end(), i);
+        if(it == m_Rows.end() || *it != i)
+        {
+            return T();
+        }
+        return m_Values[it - m_Rows.begin()];
+    }
+
+    template<typename T, typename Alloc>
+    void SparseColumn<T, Alloc>::set(unsigned int i, const T value)
+    {
+        auto it = std::lower_bound(m_Rows.begin(), m_Rows.end(), i);
+        size_t k = it - m_Rows.begin();
+        if(it != m_Rows.end() && *it == i)
+        {
+            if(value == T())
+            {
+                m_Rows.erase(it);
+                m_Values.erase(m_Values.begin() + k);
+            }
+            else
+            {
+                m_Values[k] = value;
+            }
+        }
+        else if(value != T())
+        {
+            m_Rows.insert(it, i);
+            m_Values.insert(m_Values.begin() + k, value);
+        }
+    }
+
+    template<typename T, typename Alloc>
+    void SparseColumn<T, Alloc>::append(unsigned int i, const T value)
+    {
+        if(value != T())
+        {
+            m_Rows.push_back(i);
+            m_Values.push_back(value);
+        }
+    }
+
+    template<typename T, typename Alloc>
+    void SparseColumn<T, Alloc>::clear()
+    {
+        m_Rows.clear();
+        m_Values.clear();
+    }
+
+    template<typename T, typename Alloc>
+    void SparseColumn<T, Alloc>::multiply(const T value)
+    {
+        if(value == T())
+        {
+            clear();
+            return;
+        }
+        size_t n = 0;
+        for(size_t k = 0; k < m_Rows.size(); k++)
+        {
+            T temp = m_Values[k] * value;
+            if(temp != T())
+            {
+                m_Rows[n] = m_Rows[k];
+                m_Values[n] = temp;
+                n++;
+            }
+        }
+        m_Rows.resize(n);
+        m_Values.resize(n);
+    }
+
+    template<typename T, typename Alloc>
+    void SparseColumn<T, Alloc>::add(const SparseColumn<T, Alloc>& other, const T value)
+    {
+        if(value == T())
+        {
+            return;
+        }
+        //  merge into scratch buffers which are swapped in,
+        //  so repeated additions reuse the same allocations
+        static thread_local std::vector<unsigned int> rows;
+        static thread_local std::vector<T> values;
+        rows.clear();
+        values.clear();
+        size_t a = 0;
+        size_t b = 0;
+        while(a < m_Rows.size() || b < other.m_Rows.size())
+        {
+            if(b == other.m_Rows.size() || (a < m_Rows.size() && m_Rows[a] < other.m_Rows[b]))
+            {
+                rows.push_back(m_Rows[a]);
+                values.push_back(m_Values[a]);
+                a++;
+            }
+            else if(a == m_Rows.size() || other.m_Rows[b] < m_Rows[a])
+            {
+                T temp = value * other.m_Values[b];
+                if(temp != T())
+                {
+                    rows.push_back(other.m_Rows[b]);
+                    values.push_back(temp);
+                }
+                b++;
+            }
+            else
+            {
+                T temp = m_Values[a] + value * other.m_Values[b];
+                if(temp != T())
+                {
+                    rows.push_back(m_Rows[a]);
+                    values.push_back(temp);
+                }
+                a++;
+                b++;
+            }
+        }
+        takeScratch(m_Rows, rows);
+        takeScratch(m_Values, values);
+    }
+
+    template<typename T, typename Alloc>
+    void SparseColumn<T, Alloc>::exchangeRows(unsigned int i, unsigned int j)
+    {
+        if(i == j)
+        {
+            return;
+        }
+        T a = (*this)(i);
+        T b = (*this)(j);
+        if(a == T() && b == T())
+        {
+            return;
+        }
+        set(i, b);
+        set(j, a);
+    }
+
+    template<typename Alloc>
+    Z2 SparseColumn<Z2, Alloc>::operator()(unsigned int i) const
+    {
+        return Z2(std::binary_search(m_Rows.begin(), m_Rows.end(), i));
+    }
+
+    template<typename Alloc>
+    void SparseColumn<Z2, Alloc>::set(unsigned int i, const Z2 value)
+    {
+        auto it = std::lower_bound(m_Rows.begin(), m_Rows.end(), i);
+        bool present = it != m_Rows.end() && *it == i;
+        if(present && !value)
+        {
+            m_Rows.erase(it);
+        }
+        else if(!present && value)
+        {
+            m_Rows.insert(it, i);
+        }
+    }
+
+    template<typename Alloc>
+    void SparseColumn<Z2, Alloc>::append(unsigned int i, const Z2 value)
+    {
+        if(value)
+        {
+            m_Rows.push_back(i);
+        }
+    }
+
+    template<typename Alloc>
+    void SparseColumn<Z2, Alloc>::multiply(const Z2 value)
+    {
+        if(!value)
+        {
+            m_Rows.clear();
+        }
+    }
+
+    template<typename Alloc>
+    void SparseColumn<Z2, Alloc>::add(const SparseColumn<Z2, Alloc>& other, const Z2 value)
+    {
+        if(!value)
+        {
+            return;
+        }
+        static thread_local std::vector<unsigned int> rows;
+        rows.clear();
+        std::set_symmetric_difference(m_Rows.begin(), m_Rows.end(),
+                                      other.m_Rows.begin(), other.m_Rows.end(),
+                                      std::back_inserter(rows));
+        takeScratch(m_Rows, rows);
+    }
+
+    template<typename Alloc>
+    void SparseColumn<Z2, Alloc>::exchangeRows(unsigned int i, unsigned int j)
+    {
+        if(i == j)
+        {
+            return;
+        }
+        Z2 a = (*this)(i);
+        Z2 b = (*this)(j);
+        if(a != b)
+        {
+            set(i, b);
+            set(j, a);
+        }
+    }
+
+    template<typename T, typename Alloc>
+    SparseMatrix<T, Alloc>::SparseMatrix() : m_N(0), m_M(0)
+    {
+
+    }
+
+    template<typename T, typename Alloc>
+    SparseMatrix<T, Alloc>::~SparseMatrix()
+    {
+
+    }
+
+    template<typename T, typename Alloc>
+    SparseMatrix<T, Alloc>::SparseMatrix(unsigned int n, unsigned int m, const Alloc& alloc)
+    : m_N(n), m_M(m), m_Columns(m, SparseColumn<T, Alloc>(alloc))
+    {
+
+    }
+
+    template<typename T, typename Alloc>
+    SparseMatrix<T, Alloc>::SparseMatrix(const Matrix<T>& mat) : m_N(mat.getN()), m_M(mat.getM()), m_Columns(mat.getM())
+    {
+        //  row-major sweep, so each column receives its rows in order
+        for(unsigned int i = 0; i < m_N; i++)
+        {
+            for(unsigned int j = 0; j < m_M; j++)
+            {
+                m_Columns[j].append(i, mat(i,j));
+            }
+        }
+    }
+
+    template<typename T, typename Alloc>
+    size_t SparseMatrix<T, Alloc>::getNonZeros() const
+    {
+        size_t nnz = 0;
+        for(unsigned int j = 0; j < m_M; j++)
+        {
+            nnz += m_Columns[j].getNonZeros();
+        }
+        return nnz;
+    }
+
+    template<typename T, typename Alloc>
+    SparseMatrix<T, Alloc>::SparseMatrix(const std::string& filename) : m_N(0), m_M(0)
+    {
+        MappedFile file(filename);
+        if(!isMatrixFile(file.getData(), file.getSize()) || !((const MatrixFileHeader*)file.getData())->sparse)
+        {
+            *this = SparseMatrix<T, Alloc>(Matrix<T>(filename));
+            return;
+        }
+        MappedMatrix<T> mapped(std::move(file));
+        if(!mapped.isValid())
+        {
+            return;
+        }
+        m_N = mapped.getN();
+        m_M = mapped.getM();
+        m_Columns.resize(m_M);
+        const uint64_t* offsets = mapped.getColumnOffsets();
+        for(unsigned int j = 0; j < m_M; j++)
+        {
+            SparseColumn<T, Alloc>& column = m_Columns[j];
+            for(uint64_t k = offsets[j]; k < offsets[j + 1]; k++)
+            {
+                unsigned int i = mapped.getRowIndices()[k];
+                if(i >= m_N)
+                {
+                    std::cout << "ERROR! Row " << i << " of column " << j << " exceeds matrix of size (" << m_N << "," << m_M << ")!" << std::endl;
+                    continue;
+                }
+                if(column.isEmpty() || column.getPivot() < i)
+                {
+                    if(mapped.getValues()[k] != T())
+                    {
+                        column.append(i, mapped.getValues()[k]);
+                    }
+                }
+                else
+                {
+                    column.set(i, mapped.getValues()[k]);
+                }
+            }
+        }
+    }
+
+    template<typename T, typename Alloc>
+    T SparseMatrix<T, Alloc>::operator()(unsigned int i, unsigned int j) const
+    {
+#ifdef CUBICAL_CHECKED
+        if(i >= m_N || j >= m_M)
+        {
+            throwIndexError(i, j, m_N, m_M);
+        }
+#endif
+        return m_Columns[j](i);
+    }
+
+    template<typename T, typename Alloc>
+    void SparseMatrix<T, Alloc>::set(unsigned int i, unsigned int j, const T value)
+    {
+#ifdef CUBICAL_CHECKED
+        if(i >= m_N || j >= m_M)
+        {
+            throwIndexError(i, j, m_N, m_M);
+        }
+#endif
+        m_Columns[j].set(i, value);
+    }
+
+    template<typename T, typename Alloc>
+    void SparseMatrix<T, Alloc>::rowExchange(unsigned int i, unsigned int j)
+    {
+        if( i >= m_N || j >= m_N)
+        {
+            std::cout << "ERROR! Rows (" << i << "," << j << ") exceed matrix of size (" << m_N << "," << m_M << ")!" << std::endl;
+            return;
+        }
+        for(unsigned int k = 0; k < m_M; k++)
+        {
+            m_Columns[k].exchangeRows(i, j);
+        }
+    }
+
+    template<typename T, typename Alloc>
+    void SparseMatrix<T, Alloc>::rowMultiply(unsigned int i, const T value)
+    {
+        if( i >= m_N)
+        {
+            std::cout << "ERROR! Row " << i << " exceed matrix of size (" << m_N << "," << m_M << ")!" << std::endl;
+            return;
+        }
+        for(unsigned int k = 0; k < m_M; k++)
+        {
+            T temp = m_Columns[k](i);
+            if(temp != T())
+            {
+                m_Columns[k].set(i, temp * value);
+            }
+        }
+    }
+
+    template<typename T, typename Alloc>
+    void SparseMatrix<T, Alloc>::rowAdd(unsigned int i, unsigned int j, const T value)
+    {
+        if( i >= m_N || j >= m_N)
+        {
+            std::cout << "ERROR! Rows (" << i << "," << j << ") exceed matrix of size (" << m_N << "," << m_M << ")!" << std::endl;
+            return;
+        }
+        for(unsigned int k = 0; k < m_M; k++)
+        {
+            T temp = m_Columns[k](j);
+            if(temp != T())
+            {
+                m_Columns[k].set(i, m_Columns[k](i) + value * temp);
+            }
+        }
+    }
+
+    template<typename T, typename Alloc>
+    void SparseMatrix<T, Alloc>::columnExchange(unsigned int i, unsigned int j)
+    {
+        if( i >= m_M || j >= m_M)
+        {
+            std::cout << "ERROR! columns (" << i << "," << j << ") exceed matrix of size (" << m_N << "," << m_M << ")!" << std::endl;
+            return;
+        }
+        std::swap(m_Columns[i], m_Columns[j]);
+    }
+
+    template<typename T, typename Alloc>
+    void SparseMatrix<T, Alloc>::columnMultiply(unsigned int i, const T value)
+    {
+        if( i >= m_M)
+        {
+            std::cout << "ERROR! column " << i << " exceed matrix of size (" << m_N << "," << m_M << ")!" << std::endl;
+            return;
+        }
+        m_Columns[i].multiply(value);
+    }
+
+    template<typename T, typename Alloc>
+    void SparseMatrix<T, Alloc>::columnAdd(unsigned int i, unsigned int j, const T value)
+    {
+        if( i >= m_M || j >= m_M)
+        {
+            std::cout << "ERROR! columns (" << i << "," << j << ") exceed matrix of size (" << m_N << "," << m_M << ")!" << std::endl;
+            return;
+        }
+        m_Columns[i].add(m_Columns[j], value);
+    }
+
+    template<typename T, typename Alloc>
+    Matrix<T> SparseMatrix<T, Alloc>::toDense() const
+    {
+        Matrix<T> temp(m_N, m_M);
+        for(unsigned int j = 0; j < m_M; j++)
+        {
+            const SparseColumn<T, Alloc>& column = m_Columns[j];
+            for(unsigned int k = 0; k < column.getNonZeros(); k++)
+            {
+                temp(column.getRow(k), j) = column.getValue(k);
+            }
+        }
+        return temp;
+    }
+
+    template<typename T, typename Alloc>
+    void SparseMatrix<T, Alloc>::print()
+    {
+        toDense().print();
+    }
+
+    template<typename T, typename Alloc>
+    bool SparseMatrix<T, Alloc>::save(const std::string& filename) const
+    {
+        std::vector<uint64_t> offsets(m_M + 1, 0);
+        std::vector<uint32_t> indices;
+        std::vector<T> values;
+        indices.reserve(getNonZeros());
+        values.reserve(getNonZeros());
+        for(unsigned int j = 0; j < m_M; j++)
+        {
+            const SparseColumn<T, Alloc>& column = m_Columns[j];
+            for(unsigned int k = 0; k < column.getNonZeros(); k++)
+            {
+                indices.push_back(column.getRow(k));
+                values.push_back(column.getValue(k));
+            }
+            offsets[j + 1] = indices.size();
+        }
+        std::vector<std::pair<const void*, size_t> > sections;
+        sections.push_back(std::make_pair((const void*)offsets.data(), offsets.size() * sizeof(uint64_t)));
+        sections.push_back(std::make_pair((const void*)indices.data(), indices.size() * sizeof(uint32_t)));
+        sections.push_back(std::make_pair((const void*)values.data(), values.size() * sizeof(T)));
+        return writeMatrixFile(filename, makeMatrixFileHeader<T>(m_N, m_M, true, values.size()), sections);
+    }
+
+}
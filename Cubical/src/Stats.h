@@ -0,0 +1,256 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <algorithm>
+
+//  Opt-in instrumentation of the reduction and matrix hot paths. Builds
+//  define CUBICAL_STATS to count and time, otherwise every CUBICAL_STATS_
+//  macro expands to nothing and the hot paths are unchanged.
+#ifdef CUBICAL_STATS
+#define CUBICAL_STATS_ADD(counter, n) Cubical::getStatsCounters().counter.fetch_add((n), std::memory_order_relaxed)
+#define CUBICAL_STATS_MAX(counter, n) Cubical::updateStatsMax(Cubical::getStatsCounters().counter, (n))
+#define CUBICAL_STATS_CONCAT2(a, b) a##b
+#define CUBICAL_STATS_CONCAT(a, b) CUBICAL_STATS_CONCAT2(a, b)
+#define CUBICAL_STATS_SCOPE(name, dim) Cubical::StatsTimer CUBICAL_STATS_CONCAT(cubicalStatsTimer, __LINE__)(name, dim)
+#else
+#define CUBICAL_STATS_ADD(counter, n) ((void)0)
+#define CUBICAL_STATS_MAX(counter, n) ((void)0)
+#define CUBICAL_STATS_SCOPE(name, dim) ((void)0)
+#endif
+
+namespace Cubical
+{
+    //  Maximum cell dimension timed separately, higher ones share the last slot.
+    const unsigned int StatsDimensions = 8;
+
+    //  Snapshot of the counters, all zero unless built with CUBICAL_STATS.
+    struct Stats
+    {
+        //  reduction
+        uint64_t columnAdds;
+        uint64_t pivotLookups;
+        //  columns paired as apparent pairs without reduction
+        uint64_t apparentPairs;
+        //  entries gained by column additions, net of cancellations,
+        //  and the largest column seen after an addition
+        int64_t fillIn;
+        uint64_t maxColumn;
+        //  seconds spent reducing the columns of each dimension
+        double dimensionTime[StatsDimensions];
+        //  pool and arena traffic
+        uint64_t allocations;
+        uint64_t allocatedBytes;
+        uint64_t chunks;
+        //  dense matrices
+        uint64_t matrixMultiplies;
+        uint64_t elementaryOperations;
+
+        void print() const;
+    };
+
+    //  live counters, updated with relaxed atomics from any thread
+    struct StatsCounters
+    {
+        std::atomic<uint64_t> columnAdds;
+        std::atomic<uint64_t> pivotLookups;
+        std::atomic<uint64_t> apparentPairs;
+        std::atomic<int64_t> fillIn;
+        std::atomic<uint64_t> maxColumn;
+        std::atomic<uint64_t> dimensionTime[StatsDimensions];
+        std::atomic<uint64_t> allocations;
+        std::atomic<uint64_t> allocatedBytes;
+        std::atomic<uint64_t> chunks;
+        std::atomic<uint64_t> matrixMultiplies;
+        std::atomic<uint64_t> elementaryOperations;
+    };
+
+    //  one complete event of a Chrome trace, times in microseconds
+    struct StatsEvent
+    {
+        const char* name;
+        int dim;
+        double start;
+        double duration;
+        size_t thread;
+    };
+
+    inline StatsCounters& getStatsCounters()
+    {
+        static StatsCounters counters{};
+        return counters;
+    }
+
+    inline void updateStatsMax(std::atomic<uint64_t>& counter, uint64_t value)
+    {
+        uint64_t current = counter.load(std::memory_order_relaxed);
+        while(value > current && !counter.compare_exchange_weak(current, value, std::memory_order_relaxed))
+        {
+
+        }
+    }
+
+    //  trace events are only kept once tracing is enabled
+    struct StatsTrace
+    {
+        std::mutex mutex;
+        bool enabled = false;
+        std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+        std::vector<StatsEvent> events;
+    };
+
+    inline StatsTrace& getStatsTrace()
+    {
+        static StatsTrace trace;
+        return trace;
+    }
+
+    inline Stats getStats()
+    {
+        StatsCounters& c = getStatsCounters();
+        Stats stats;
+        stats.columnAdds = c.columnAdds.load();
+        stats.pivotLookups = c.pivotLookups.load();
+        stats.apparentPairs = c.apparentPairs.load();
+        stats.fillIn = c.fillIn.load();
+        stats.maxColumn = c.maxColumn.load();
+        for(unsigned int d = 0; d < StatsDimensions; d++)
+        {
+            stats.dimensionTime[d] = c.dimensionTime[d].load() * 1e-9;
+        }
+        stats.allocations = c.allocations.load();
+        stats.allocatedBytes = c.allocatedBytes.load();
+        stats.chunks = c.chunks.load();
+        stats.matrixMultiplies = c.matrixMultiplies.load();
+        stats.elementaryOperations = c.elementaryOperations.load();
+        return stats;
+    }
+
+    //  zeroes the counters and drops recorded trace events
+    inline void resetStats()
+    {
+        StatsCounters& c = getStatsCounters();
+        c.columnAdds = 0;
+        c.pivotLookups = 0;
+        c.apparentPairs = 0;
+        c.fillIn = 0;
+        c.maxColumn = 0;
+        for(unsigned int d = 0; d < StatsDimensions; d++)
+        {
+            c.dimensionTime[d] = 0;
+        }
+        c.allocations = 0;
+        c.allocatedBytes = 0;
+        c.chunks = 0;
+        c.matrixMultiplies = 0;
+        c.elementaryOperations = 0;
+        StatsTrace& trace = getStatsTrace();
+        std::lock_guard<std::mutex> lock(trace.mutex);
+        trace.events.clear();
+    }
+
+    inline void enableTrace(bool enabled = true)
+    {
+        StatsTrace& trace = getStatsTrace();
+        std::lock_guard<std::mutex> lock(trace.mutex);
+        trace.enabled = enabled;
+    }
+
+    //  Times a scope. The duration is added to the time of dimension dim
+    //  when dim is not negative and recorded as a trace event when tracing
+    //  is enabled. name must outlive the trace, string literals are used.
+    class StatsTimer
+    {
+        public:
+            StatsTimer(const char* name, int dim = -1) : m_Name(name), m_Dim(dim), m_Start(std::chrono::steady_clock::now()) {}
+            StatsTimer(const StatsTimer&) = delete;
+            StatsTimer& operator=(const StatsTimer&) = delete;
+            virtual ~StatsTimer();
+
+        private:
+            const char* m_Name;
+            int m_Dim;
+            std::chrono::steady_clock::time_point m_Start;
+    };
+
+    inline StatsTimer::~StatsTimer()
+    {
+        auto end = std::chrono::steady_clock::now();
+        if(m_Dim >= 0)
+        {
+            unsigned int d = std::min((unsigned int)m_Dim, StatsDimensions - 1);
+            uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - m_Start).count();
+            getStatsCounters().dimensionTime[d].fetch_add(ns, std::memory_order_relaxed);
+        }
+        StatsTrace& trace = getStatsTrace();
+        std::lock_guard<std::mutex> lock(trace.mutex);
+        if(trace.enabled)
+        {
+            StatsEvent event;
+            event.name = m_Name;
+            event.dim = m_Dim;
+            event.start = std::chrono::duration<double, std::micro>(m_Start - trace.origin).count();
+            event.duration = std::chrono::duration<double, std::micro>(end - m_Start).count();
+            event.thread = std::hash<std::thread::id>()(std::this_thread::get_id()) % 1000000;
+            trace.events.push_back(event);
+        }
+    }
+
+    //  writes the recorded events in the Chrome trace event format, to be
+    //  opened in chrome://tracing or Perfetto
+    inline bool saveTrace(const std::string& filename)
+    {
+        std::ofstream file(filename);
+        if(!file)
+        {
+            std::cout << "ERROR! Could not open file " << filename << "!" << std::endl;
+            return false;
+        }
+        StatsTrace& trace = getStatsTrace();
+        std::lock_guard<std::mutex> lock(trace.mutex);
+        file.precision(15);
+        file << "{\"traceEvents\": [\n";
+        for(size_t k = 0; k < trace.events.size(); k++)
+        {
+            const StatsEvent& e = trace.events[k];
+            file << "  {\"name\": \"" << e.name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << e.thread
+                 << ", \"ts\": " << e.start << ", \"dur\": " << e.duration;
+            if(e.dim >= 0)
+            {
+                file << ", \"args\": {\"dim\": " << e.dim << "}";
+            }
+            file << "}" << (k + 1 < trace.events.size() ? ",\n" : "\n");
+        }
+        file << "]}\n";
+        return (bool)file;
+    }
+
+    inline void Stats::print() const
+    {
+        std::cout << "column adds:           " << columnAdds << "\n"
+                  << "pivot lookups:         " << pivotLookups << "\n"
+                  << "apparent pairs:        " << apparentPairs << "\n"
+                  << "fill-in:               " << fillIn << "\n"
+                  << "largest column:        " << maxColumn << "\n"
+                  << "allocations:           " << allocations << " (" << allocatedBytes << " bytes, " << chunks << " chunks)\n"
+                  << "matrix multiplies:     " << matrixMultiplies << "\n"
+                  << "elementary operations: " << elementaryOperations << "\n";
+        for(unsigned int d = 0; d < StatsDimensions; d++)
+        {
+            if(dimensionTime[d] > 0)
+            {
+                std::cout << "dimension " << d << ":           " << dimensionTime[d] << " s\n";
+            }
+        }
+        std::cout << std::flush;
+    }
+
+}
@@ -0,0 +1,296 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <limits>
+
+#include "CubicalComplex.h"
+#include "ColumnStore.h"
+#include "Persistence.h"
+#include "SparseMatrix.h"
+#include "Z2.h"
+
+namespace Cubical
+{
+    //  Persistence of the sublevel filtration of a cubical complex whose
+    //  reduced boundary matrix does not fit in memory. Cells are produced
+    //  in filtration order a batch at a time and every column is reduced as
+    //  soon as its cell appears. Only reduced columns owning a pivot are
+    //  kept, in a ColumnStore that spills the least recently used ones to
+    //  disk once they exceed the budget.
+    //
+    //  Batches come from a bucket sort by value. Bucket bounds are
+    //  quantiles of a sample of the values, so that a bucket holds about
+    //  one batch, and a single pass places every cell in its bucket. Each
+    //  bucket is then sorted on its own when it is reached, so every cell
+    //  is placed once however small the batches are.
+    //
+    //  The budget bounds everything held per cell: the order, position
+    //  and pivot of every cell, the values of the complex, and the stored
+    //  columns with their spill index. Columns get what the rest leaves,
+    //  and a warning is printed when the rest alone exceeds the budget.
+    //  An implicit complex keeps only the grid, about an eighth of the
+    //  values of a 3-dimensional complex.
+    //  Columns are reduced in filtration order by the standard algorithm
+    //  with the column additions of SparseColumn, so the pairs are the same
+    //  as those of Persistence.
+    template<typename T>
+    class StreamingPersistence
+    {
+        public:
+            StreamingPersistence<T>(const CubicalComplex<T>& complex, size_t budget = (size_t)1 << 30,
+                                    const std::string& directory = "/tmp");
+            virtual ~StreamingPersistence<T>();
+
+            //  getters and setters
+            //  pairs of non-zero persistence followed by essential classes
+            const std::vector<PersistencePair<T> >& getPairs() const { return m_Pairs; }
+            const ColumnStore& getStore() const { return m_Store; }
+
+            void print();
+
+        private:
+            const CubicalComplex<T>& m_Complex;
+            //  expected cells per batch
+            size_t m_Batch;
+            ColumnStore m_Store;
+            //  cells in filtration order and position of each placed cell
+            std::vector<unsigned int> m_Order;
+            std::vector<unsigned int> m_Position;
+            //  stored column owning each pivot row, numbered by the store
+            std::vector<unsigned int> m_Pivots;
+            std::vector<bool> m_Paired;
+            std::vector<PersistencePair<T> > m_Pairs;
+
+            //  bytes held per cell outside the store
+            static size_t getBookkeeping(const CubicalComplex<T>& complex);
+            static size_t getStoreBudget(const CubicalComplex<T>& complex, size_t budget);
+            //  filtration order by value, then dimension, then index
+            bool isBefore(size_t a, size_t b) const;
+            //  places the cells in m_Order bucket by bucket, with bucket b
+            //  in [starts[b], starts[b + 1])
+            void bucketCells(std::vector<size_t>& starts);
+            void generateColumn(size_t cell, SparseColumn<Z2>& column) const;
+            void reduceColumn(unsigned int j, SparseColumn<Z2>& column);
+            void reduce();
+            void addPair(unsigned int i, unsigned int j);
+    };
+
+    template<typename T>
+    StreamingPersistence<T>::StreamingPersistence(const CubicalComplex<T>& complex, size_t budget, const std::string& directory)
+    : m_Complex(complex), m_Batch(std::max((size_t)1024, budget / 16 / sizeof(size_t))),
+      m_Store(getStoreBudget(complex, budget), directory)
+    {
+        if(getBookkeeping(complex) > budget - budget / 8)
+        {
+            std::cout << "WARNING! Streaming persistence holds " << getBookkeeping(complex)
+                      << " bytes besides the columns, more than the budget of " << budget << " bytes!" << std::endl;
+        }
+        //  without a spill file every column would stay resident
+        if(!m_Store.isValid())
+        {
+            std::cout << "ERROR! Streaming persistence needs a spill file in " << directory << "!" << std::endl;
+            return;
+        }
+        reduce();
+    }
+
+    template<typename T>
+    StreamingPersistence<T>::~StreamingPersistence()
+    {
+
+    }
+
+    //  order, positions and pivots, the paired flags and the complex
+    template<typename T>
+    size_t StreamingPersistence<T>::getBookkeeping(const CubicalComplex<T>& complex)
+    {
+        return complex.getCells() * 3 * sizeof(unsigned int) + complex.getCells() / 8 + complex.getBytes();
+    }
+
+    //  an eighth of the budget is left for the working column and the
+    //  bucket bounds, and the store keeps that much when nothing is left
+    template<typename T>
+    size_t StreamingPersistence<T>::getStoreBudget(const CubicalComplex<T>& complex, size_t budget)
+    {
+        size_t bookkeeping = getBookkeeping(complex);
+        size_t rest = budget - budget / 8;
+        return bookkeeping < rest ? rest - bookkeeping : budget / 8;
+    }
+
+    template<typename T>
+    bool StreamingPersistence<T>::isBefore(size_t a, size_t b) const
+    {
+        T va = m_Complex.getValue(a);
+        T vb = m_Complex.getValue(b);
+        if(va != vb)
+        {
+            return va < vb;
+        }
+        unsigned int da = m_Complex.getCellDimension(a);
+        unsigned int db = m_Complex.getCellDimension(b);
+        if(da != db)
+        {
+            return da < db;
+        }
+        return a < b;
+    }
+
+    template<typename T>
+    void StreamingPersistence<T>::bucketCells(std::vector<size_t>& starts)
+    {
+        size_t cells = m_Complex.getCells();
+        size_t buckets = std::max((size_t)1, (cells + m_Batch - 1) / m_Batch);
+        //  a spread sample of the values, the multiplier is odd and so
+        //  avoids following the grid axes
+        size_t samples = std::min(cells, buckets * 64);
+        std::vector<T> sample(samples);
+        for(size_t k = 0; k < samples; k++)
+        {
+            sample[k] = m_Complex.getValue(k * 2654435761u % cells);
+        }
+        std::sort(sample.begin(), sample.end());
+        std::vector<T> bounds;
+        for(size_t b = 1; b < buckets; b++)
+        {
+            T bound = sample[samples * b / buckets];
+            if(bounds.empty() || bounds.back() < bound)
+            {
+                bounds.push_back(bound);
+            }
+        }
+        //  cells of equal value share a bucket, so faces never follow
+        //  their cofaces
+        auto bucket = [&](size_t cell)
+        {
+            return std::upper_bound(bounds.begin(), bounds.end(), m_Complex.getValue(cell)) - bounds.begin();
+        };
+        starts.assign(bounds.size() + 3, 0);
+        for(size_t cell = 0; cell < cells; cell++)
+        {
+            starts[bucket(cell) + 2]++;
+        }
+        for(size_t b = 2; b < starts.size(); b++)
+        {
+            starts[b] += starts[b - 1];
+        }
+        m_Order.resize(cells);
+        for(size_t cell = 0; cell < cells; cell++)
+        {
+            m_Order[starts[bucket(cell) + 1]++] = cell;
+        }
+        starts.pop_back();
+    }
+
+    template<typename T>
+    void StreamingPersistence<T>::generateColumn(size_t cell, SparseColumn<Z2>& column) const
+    {
+        size_t faces[64];
+        unsigned int count = 2 * m_Complex.getFaces(cell, faces);
+        unsigned int rows[64];
+        for(unsigned int k = 0; k < count; k++)
+        {
+            rows[k] = m_Position[faces[k]];
+        }
+        std::sort(rows, rows + count);
+        column.clear();
+        for(unsigned int k = 0; k < count; k++)
+        {
+            column.append(rows[k], Z2(1));
+        }
+    }
+
+    template<typename T>
+    void StreamingPersistence<T>::reduceColumn(unsigned int j, SparseColumn<Z2>& column)
+    {
+        while(!column.isEmpty())
+        {
+            unsigned int pivot = column.getPivot();
+            unsigned int k = m_Pivots[pivot];
+            CUBICAL_STATS_ADD(pivotLookups, 1);
+            if(k == std::numeric_limits<unsigned int>::max())
+            {
+                m_Pivots[pivot] = m_Store.insert(column);
+                addPair(pivot, j);
+                return;
+            }
+#ifdef CUBICAL_STATS
+            size_t before = column.getNonZeros();
+            column.add(m_Store.get(k), Z2(1));
+            CUBICAL_STATS_ADD(columnAdds, 1);
+            CUBICAL_STATS_ADD(fillIn, (int64_t)column.getNonZeros() - (int64_t)before);
+            CUBICAL_STATS_MAX(maxColumn, column.getNonZeros());
+#else
+            column.add(m_Store.get(k), Z2(1));
+#endif
+        }
+    }
+
+    template<typename T>
+    void StreamingPersistence<T>::reduce()
+    {
+        size_t cells = m_Complex.getCells();
+        m_Position.assign(cells, std::numeric_limits<unsigned int>::max());
+        m_Pivots.assign(cells, std::numeric_limits<unsigned int>::max());
+        m_Paired.assign(cells, false);
+        std::vector<size_t> starts;
+        SparseColumn<Z2> column;
+        CUBICAL_STATS_SCOPE("streaming reduce", -1);
+        bucketCells(starts);
+        auto before = [this](unsigned int a, unsigned int b) { return isBefore(a, b); };
+        for(size_t b = 0; b + 1 < starts.size(); b++)
+        {
+            std::sort(m_Order.begin() + starts[b], m_Order.begin() + starts[b + 1], before);
+            for(size_t j = starts[b]; j < starts[b + 1]; j++)
+            {
+                //  faces precede the cell, so their positions are known
+                m_Position[m_Order[j]] = j;
+                generateColumn(m_Order[j], column);
+                reduceColumn(j, column);
+            }
+        }
+        for(unsigned int j = 0; j < cells; j++)
+        {
+            if(!m_Paired[j])
+            {
+                unsigned int cell = m_Order[j];
+                PersistencePair<T> pair = { m_Complex.getCellDimension(cell), m_Complex.getValue(cell), std::numeric_limits<T>::max(), true };
+                m_Pairs.push_back(pair);
+            }
+        }
+    }
+
+    template<typename T>
+    void StreamingPersistence<T>::addPair(unsigned int i, unsigned int j)
+    {
+        m_Paired[i] = true;
+        m_Paired[j] = true;
+        unsigned int birth = m_Order[i];
+        unsigned int death = m_Order[j];
+        if(m_Complex.getValue(birth) < m_Complex.getValue(death))
+        {
+            PersistencePair<T> pair = { m_Complex.getCellDimension(birth), m_Complex.getValue(birth), m_Complex.getValue(death), false };
+            m_Pairs.push_back(pair);
+        }
+    }
+
+    template<typename T>
+    void StreamingPersistence<T>::print()
+    {
+        for(unsigned int k = 0; k < m_Pairs.size(); k++)
+        {
+            std::cout << m_Pairs[k].dim << ": [" << +m_Pairs[k].birth << ", ";
+            if(m_Pairs[k].essential)
+            {
+                std::cout << "inf)\n";
+            }
+            else
+            {
+                std::cout << +m_Pairs[k].death << ")\n";
+            }
+        }
+    }
+
+}
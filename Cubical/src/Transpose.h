@@ -0,0 +1,164 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <utility>
+
+namespace Cubical
+{
+    //  side below which a block is transposed directly, a block of this
+    //  size and its image fit in the first level cache for 8 byte types
+    const unsigned int TransposeBlock = 32;
+
+    //  out[j * n + i] = rows[i][j] over rows [i0, i1) and columns [j0, j1),
+    //  halving the longer side until the block is small, so the recursion
+    //  fits every level of the cache without knowing its size
+    template<typename T>
+    void transposeBlock(const T* const* rows, unsigned int i0, unsigned int i1, unsigned int j0, unsigned int j1,
+                        unsigned int n, T* out)
+    {
+        while(i1 - i0 > TransposeBlock || j1 - j0 > TransposeBlock)
+        {
+            if(i1 - i0 >= j1 - j0)
+            {
+                unsigned int im = i0 + (i1 - i0) / 2;
+                transposeBlock(rows, i0, im, j0, j1, n, out);
+                i0 = im;
+            }
+            else
+            {
+                unsigned int jm = j0 + (j1 - j0) / 2;
+                transposeBlock(rows, i0, i1, j0, jm, n, out);
+                j0 = jm;
+            }
+        }
+        for(unsigned int i = i0; i < i1; i++)
+        {
+            const T* a = rows[i];
+            for(unsigned int j = j0; j < j1; j++)
+            {
+                out[(size_t)j * n + i] = a[j];
+            }
+        }
+    }
+
+    //  Out-of-place transpose of the n x m matrix with the given row
+    //  pointers into the contiguous m x n matrix out. Rows may be in any
+    //  order, which applies a row permutation for free. The columns are
+    //  split over the threads, so each writes its own rows of out.
+    template<typename T>
+    void transposeInto(unsigned int n, unsigned int m, const T* const* rows, T* out, unsigned int threads = 1)
+    {
+        unsigned int blocks = (m + TransposeBlock - 1) / TransposeBlock;
+        threads = std::max(1u, std::min(threads, blocks));
+        if(threads == 1)
+        {
+            transposeBlock(rows, 0, n, 0, m, n, out);
+            return;
+        }
+        std::vector<std::thread> workers;
+        for(unsigned int t = 0; t < threads; t++)
+        {
+            unsigned int j0 = std::min(m, blocks * t / threads * TransposeBlock);
+            unsigned int j1 = std::min(m, blocks * (t + 1) / threads * TransposeBlock);
+            workers.push_back(std::thread(transposeBlock<T>, rows, 0u, n, j0, j1, n, out));
+        }
+        for(unsigned int t = 0; t < threads; t++)
+        {
+            workers[t].join();
+        }
+    }
+
+    //  exchanges block [i0, i1) x [j0, j1) of the n x n matrix data with
+    //  its mirror image [j0, j1) x [i0, i1), the blocks must not overlap
+    template<typename T>
+    void transposeSwap(T* data, unsigned int n, unsigned int i0, unsigned int i1, unsigned int j0, unsigned int j1)
+    {
+        while(i1 - i0 > TransposeBlock || j1 - j0 > TransposeBlock)
+        {
+            if(i1 - i0 >= j1 - j0)
+            {
+                unsigned int im = i0 + (i1 - i0) / 2;
+                transposeSwap(data, n, i0, im, j0, j1);
+                i0 = im;
+            }
+            else
+            {
+                unsigned int jm = j0 + (j1 - j0) / 2;
+                transposeSwap(data, n, i0, i1, j0, jm);
+                j0 = jm;
+            }
+        }
+        for(unsigned int i = i0; i < i1; i++)
+        {
+            for(unsigned int j = j0; j < j1; j++)
+            {
+                std::swap(data[(size_t)i * n + j], data[(size_t)j * n + i]);
+            }
+        }
+    }
+
+    //  transposes the diagonal block [i0, i1) x [i0, i1) in place
+    template<typename T>
+    void transposeDiagonal(T* data, unsigned int n, unsigned int i0, unsigned int i1)
+    {
+        if(i1 - i0 <= TransposeBlock)
+        {
+            for(unsigned int i = i0; i < i1; i++)
+            {
+                for(unsigned int j = i + 1; j < i1; j++)
+                {
+                    std::swap(data[(size_t)i * n + j], data[(size_t)j * n + i]);
+                }
+            }
+            return;
+        }
+        unsigned int im = i0 + (i1 - i0) / 2;
+        transposeDiagonal(data, n, i0, im);
+        transposeDiagonal(data, n, im, i1);
+        transposeSwap(data, n, i0, im, im, i1);
+    }
+
+    //  In-place transpose of the contiguous n x n matrix data. Bands of
+    //  rows, each with its diagonal block and the blocks to its right,
+    //  are handed out to the threads. Bands touch disjoint entries, and
+    //  there are several per thread because their work shrinks down the
+    //  diagonal.
+    template<typename T>
+    void transposeSquare(T* data, unsigned int n, unsigned int threads = 1)
+    {
+        unsigned int blocks = (n + TransposeBlock - 1) / TransposeBlock;
+        threads = std::max(1u, std::min(threads, blocks));
+        if(threads == 1)
+        {
+            transposeDiagonal(data, n, 0, n);
+            return;
+        }
+        unsigned int bands = std::min(blocks, threads * 8);
+        std::atomic<unsigned int> next(0);
+        std::vector<std::thread> workers;
+        for(unsigned int t = 0; t < threads; t++)
+        {
+            workers.push_back(std::thread([&]()
+            {
+                for(unsigned int band = next++; band < bands; band = next++)
+                {
+                    unsigned int i0 = std::min(n, blocks * band / bands * TransposeBlock);
+                    unsigned int i1 = std::min(n, blocks * (band + 1) / bands * TransposeBlock);
+                    transposeDiagonal(data, n, i0, i1);
+                    if(i1 < n)
+                    {
+                        transposeSwap(data, n, i0, i1, i1, n);
+                    }
+                }
+            }));
+        }
+        for(unsigned int t = 0; t < threads; t++)
+        {
+            workers[t].join();
+        }
+    }
+
+}
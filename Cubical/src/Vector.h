@@ -3,196 +3,499 @@
 #include <string>
 #include <vector>
 #include <iostream>
+#include <cmath>
+#include <cstring>
+#include <utility>
+#include <type_traits>
+
+#include "Error.h"
+#include "Expression.h"
+#include "View.h"
 
 namespace Cubical
 {
-    template<typename T>
-    class Vector
+    //  Dot products of fixed size vectors. Arithmetic vectors filling a
+    //  16, 32 or 64 byte register are multiplied as one GCC vector, others
+    //  by a fully unrolled loop.
+    template<typename T, unsigned int N, bool = std::is_arithmetic<T>::value &&
+             (N * sizeof(T) == 16 || N * sizeof(T) == 32 || N * sizeof(T) == 64)>
+    struct FixedKernel
+    {
+        template<size_t... I>
+        static T dot(const T* a, const T* b, std::index_sequence<I...>)
+        {
+            T sum = T();
+            ((sum += a[I] * b[I]), ...);
+            return sum;
+        }
+        static T dot(const T* a, const T* b) { return dot(a, b, std::make_index_sequence<N>()); }
+    };
+
+    template<typename T, unsigned int N>
+    struct FixedKernel<T, N, true>
+    {
+        typedef T Vec __attribute__((vector_size(N * sizeof(T))));
+        static T dot(const T* a, const T* b)
+        {
+            Vec va;
+            Vec vb;
+            std::memcpy(&va, a, sizeof(Vec));
+            std::memcpy(&vb, b, sizeof(Vec));
+            Vec product = va * vb;
+            T sum = T();
+            for(unsigned int k = 0; k < N; k++)
+            {
+                sum += product[k];
+            }
+            return sum;
+        }
+    };
+
+    //  Vector of compile time dimension N with inline storage, for the
+    //  small geometric vectors of point clouds. The dimensions of fixed
+    //  size operands are checked at compile time. Alloc is unused.
+    template<typename T, unsigned int N, typename Alloc>
+    class Vector : public VectorExpression<Vector<T, N, Alloc> >
     {
         public:
-            Vector<T>();
-            virtual ~Vector<T>();
-            Vector<T>(std::vector<T> vec);
+            typedef T value_type;
+            static const unsigned int Dim = N;
+
+            Vector<T, N, Alloc>() : m_Vec() {}
+            //  one value per coordinate, other counts do not compile
+            template<typename... A, typename = typename std::enable_if<
+                     sizeof...(A) == N && std::conjunction<std::is_convertible<A, T>...>::value>::type>
+            Vector<T, N, Alloc>(A... values) : m_Vec{T(values)...} {}
+            //  evaluates an expression such as a + b * 2 - c in one pass
+            template<typename E>
+            Vector<T, N, Alloc>(const VectorExpression<E>& expression);
+            template<typename E>
+            Vector<T, N, Alloc>& operator=(const VectorExpression<E>& expression);
 
             //  getters and setters
-            unsigned int getDim() const { return m_Dim; }
+            unsigned int getDim() const { return N; }
+            //  unchecked access used by expressions
+            T get(unsigned int i) const { return m_Vec[i]; }
+            T getUnchecked(unsigned int i) const { return m_Vec[i]; }
+            bool isValid() const { return true; }
+            const T* getData() const { return m_Vec; }
+            T* getData() { return m_Vec; }
+            VectorView<const T> getView() const { return VectorView<const T>(m_Vec, N); }
+            VectorView<T> getView() { return VectorView<T>(m_Vec, N); }
 
-            //  operator overloads
+            //  operator overloads, bounds checked in CUBICAL_CHECKED builds
             T operator()(unsigned int i) const;
             T& operator()(unsigned int i);
-            //  addition
-            Vector<T> operator+(const Vector<T>& other) const;
-            void operator+=(const Vector<T>& other);
-            //  subtraction
-            Vector<T> operator-(const Vector<T>& other) const;
-            void operator-=(const Vector<T>& other);
-            //  scalar multiplication
-            Vector<T> operator*(const T scalar) const;
+            //  addition and subtraction, a + b and a - b are expressions
+            template<typename E>
+            void operator+=(const VectorExpression<E>& other);
+            template<typename E>
+            void operator-=(const VectorExpression<E>& other);
+            //  scalar multiplication, a * scalar is an expression
             void operator*=(const T scalar);
             //  is equal
-            bool operator==(const Vector<T>& other) const;
+            bool operator==(const Vector<T, N, Alloc>& other) const;
             //  dot product
-            T operator*(const Vector<T>& other) const;
+            template<unsigned int M, typename B>
+            T operator*(const Vector<T, M, B>& other) const;
             //  norm
-            void findNorm();
+            T getSquaredNorm() const { return FixedKernel<T, N>::dot(m_Vec, m_Vec); }
+            T getNorm() const { return T(std::sqrt(getSquaredNorm())); }
             void normalize();
-            T const getNorm();
-            //  cross product 
-            Vector<T> cross(const Vector<T>& other) const;
+            //  cross product, only defined for N = 3
+            Vector<T, N, Alloc> cross(const Vector<T, N, Alloc>& other) const;
             //  projection
-            Vector<T> projection(const Vector<T>& other) const;
+            Vector<T, N, Alloc> projection(const Vector<T, N, Alloc>& other) const;
 
             void print();
 
         private:
-            //  size
-            unsigned int m_Dim;
-            //  vector
-            std::vector<T> m_Vec;
-            //  norm
-            T m_Norm;
+            T m_Vec[N];
     };
 
-    template<typename T>
-    Vector<T>::Vector() : m_Dim(0)
+    template<typename T, unsigned int N, typename Alloc>
+    T Vector<T, N, Alloc>::operator()(unsigned int i) const
     {
-
+#ifdef CUBICAL_CHECKED
+        if(i >= N)
+        {
+            throwIndexError(i, N);
+        }
+#endif
+        return m_Vec[i];
     }
 
-    template<typename T>
-    Vector<T>::~Vector()
+    template<typename T, unsigned int N, typename Alloc>
+    T& Vector<T, N, Alloc>::operator()(unsigned int i)
     {
-
+#ifdef CUBICAL_CHECKED
+        if(i >= N)
+        {
+            throwIndexError(i, N);
+        }
+#endif
+        return m_Vec[i];
     }
 
-    template<typename T>
-    Vector<T>::Vector(std::vector<T> vec) : m_Vec(std::move(vec))
+    template<typename T, unsigned int N, typename Alloc>
+    template<typename E>
+    Vector<T, N, Alloc>::Vector(const VectorExpression<E>& expression) : m_Vec()
     {
-        m_Dim = m_Vec.size();
+        *this = expression;
     }
 
-    template<typename T>
-    T Vector<T>::operator()(unsigned int i) const
+    template<typename T, unsigned int N, typename Alloc>
+    template<typename E>
+    Vector<T, N, Alloc>& Vector<T, N, Alloc>::operator=(const VectorExpression<E>& expression)
     {
-        if(i >= m_Dim)
+        static_assert(E::Dim == N || E::Dim == Dynamic, "Vectors are not compatible!");
+        const E& e = expression.self();
+        if(e.getDim() != N)
+        {
+            std::cout << "ERROR! Vectors are not compatible!" << std::endl;
+            return *this;
+        }
+        //  element-wise, so evaluating in place is safe
+        //  even if this is an operand
+        if(e.isValid())
         {
-            std::cout << "ERROR! Index " << i << " exceed vector of size " << m_Dim << std::endl;
-            return 0;
+            for(unsigned int i = 0; i < N; i++)
+            {
+                m_Vec[i] = e.getUnchecked(i);
+            }
         }
         else
         {
-            return m_Vec[i];
-        }  
+            for(unsigned int i = 0; i < N; i++)
+            {
+                m_Vec[i] = e.get(i);
+            }
+        }
+        return *this;
     }
 
-    template<typename T>
-    T& Vector<T>::operator()(unsigned int i)
+    template<typename T, unsigned int N, typename Alloc>
+    template<typename E>
+    void Vector<T, N, Alloc>::operator+=(const VectorExpression<E>& other)
     {
-        if(i >= m_Dim)
-        {
-            std::cout << "ERROR! Index " << i << " exceed vector of size " << m_Dim << std::endl;
-            return 0;
-        }
-        else
-        {
-            return m_Vec[i];
-        }  
+        *this = *this + other;
     }
 
-    template<typename T>
-    Vector<T> Vector<T>::operator+(const Vector<T>& other) const
+    template<typename T, unsigned int N, typename Alloc>
+    template<typename E>
+    void Vector<T, N, Alloc>::operator-=(const VectorExpression<E>& other)
     {
-        std::vector<T> temp;
-        if(m_Dim != other.getDim())
+        *this = *this - other;
+    }
+
+    template<typename T, unsigned int N, typename Alloc>
+    void Vector<T, N, Alloc>::operator*=(const T scalar)
+    {
+        for(unsigned int i = 0; i < N; i++)
         {
-            std::cout << "ERROR! Vectors are not compatible!" << std::endl;
-            temp = m_Vec;
+            m_Vec[i] *= scalar;
         }
-        else
+    }
+
+    template<typename T, unsigned int N, typename Alloc>
+    bool Vector<T, N, Alloc>::operator==(const Vector<T, N, Alloc>& other) const
+    {
+        for(unsigned int i = 0; i < N; i++)
         {
-            for(unsigned int i = 0; i < m_Dim; i++)
+            if(m_Vec[i] != other.m_Vec[i])
             {
-                temp.push_back(m_Vec[i] + other(i));
+                return false;
             }
         }
-        return Vector<T>(temp);
+        return true;
     }
 
-    template<typename T>
-    void Vector<T>::operator+=(const Vector<T>& other)
+    template<typename T, unsigned int N, typename Alloc>
+    template<unsigned int M, typename B>
+    T Vector<T, N, Alloc>::operator*(const Vector<T, M, B>& other) const
     {
-        if(m_Dim != other.getDim())
+        static_assert(M == N, "Vectors are not compatible!");
+        return FixedKernel<T, N>::dot(m_Vec, other.getData());
+    }
+
+    template<typename T, unsigned int N, typename Alloc>
+    void Vector<T, N, Alloc>::normalize()
+    {
+        T norm = getNorm();
+        if(norm == T())
         {
-            std::cout << "ERROR! Vectors are not compatible!" << std::endl;
+            std::cout << "ERROR! Vector is the zero vector!" << std::endl;
             return;
         }
-        else
+        for(unsigned int i = 0; i < N; i++)
         {
-            for(unsigned int i = 0; i < m_Dim; i++)
-            {
-                m_Vec[i] += other(i);
-            }
+            m_Vec[i] /= norm;
         }
     }
 
-    template<typename T>
-    Vector<T> Vector<T>::operator-(const Vector<T>& other) const
+    template<typename T, unsigned int N, typename Alloc>
+    Vector<T, N, Alloc> Vector<T, N, Alloc>::cross(const Vector<T, N, Alloc>& other) const
     {
-        std::vector<T> temp;
-        if(m_Dim != other.getDim())
+        static_assert(N == 3, "Cross product is only defined for vectors of dimension 3!");
+        const T* b = other.m_Vec;
+        return Vector<T, N, Alloc>(m_Vec[1] * b[2] - m_Vec[2] * b[1],
+                                   m_Vec[2] * b[0] - m_Vec[0] * b[2],
+                                   m_Vec[0] * b[1] - m_Vec[1] * b[0]);
+    }
+
+    template<typename T, unsigned int N, typename Alloc>
+    Vector<T, N, Alloc> Vector<T, N, Alloc>::projection(const Vector<T, N, Alloc>& other) const
+    {
+        Vector<T, N, Alloc> temp(*this);
+        T dot = (*this) * other;
+        T norm = getSquaredNorm();
+        if(norm == T())
         {
-            std::cout << "ERROR! Vectors are not compatible!" << std::endl;
-            temp = m_Vec;
+            std::cout << "ERROR! Vector is the zero vector!" << std::endl;
+            return temp;
         }
-        else
+        temp *= dot / norm;
+        return temp;
+    }
+
+    template<typename T, unsigned int N, typename Alloc>
+    void Vector<T, N, Alloc>::print()
+    {
+        std::cout << "\n[ ";
+        for(unsigned int i = 0; i < N; i++)
         {
-            for(unsigned int i = 0; i < m_Dim; i++)
-            {
-                temp.push_back(m_Vec[i] - other(i));
-            }
+            std::cout << m_Vec[i] << " ";
         }
-        return Vector<T>(temp);
+        std::cout << "]\n";
     }
 
-    template<typename T>
-    void Vector<T>::operator-=(const Vector<T>& other)
+    //  vector of run time dimension with heap storage from Alloc
+    template<typename T, typename Alloc>
+    class Vector<T, Dynamic, Alloc> : public VectorExpression<Vector<T, Dynamic, Alloc> >
     {
-        if(m_Dim != other.getDim())
+        public:
+            typedef T value_type;
+            static const unsigned int Dim = Dynamic;
+
+            Vector<T, Dynamic, Alloc>();
+            virtual ~Vector<T, Dynamic, Alloc>();
+            Vector<T, Dynamic, Alloc>(std::vector<T, Alloc> vec);
+            Vector<T, Dynamic, Alloc>(const Vector<T, Dynamic, Alloc>& other) = default;
+            Vector<T, Dynamic, Alloc>& operator=(const Vector<T, Dynamic, Alloc>& other) = default;
+            //  takes the storage, other is left empty
+            Vector<T, Dynamic, Alloc>(Vector<T, Dynamic, Alloc>&& other) noexcept;
+            Vector<T, Dynamic, Alloc>& operator=(Vector<T, Dynamic, Alloc>&& other) noexcept;
+            //  evaluates an expression such as a + b * 2 - c in one pass
+            template<typename E>
+            Vector<T, Dynamic, Alloc>(const VectorExpression<E>& expression);
+            template<typename E>
+            Vector<T, Dynamic, Alloc>& operator=(const VectorExpression<E>& expression);
+
+            //  getters and setters
+            unsigned int getDim() const { return m_Dim; }
+            //  unchecked access used by expressions
+            T get(unsigned int i) const { return m_Vec[i]; }
+            T getUnchecked(unsigned int i) const { return m_Vec[i]; }
+            bool isValid() const { return true; }
+            Alloc getAllocator() const { return m_Vec.get_allocator(); }
+            const T* getData() const { return m_Vec.data(); }
+            //  writable access, drops the cached norm
+            T* getData() { invalidateNorm(); return m_Vec.data(); }
+            //  views of the entries without copying, valid until resized
+            VectorView<const T> getView() const { return VectorView<const T>(m_Vec.data(), m_Dim); }
+            VectorView<T> getView() { invalidateNorm(); return VectorView<T>(m_Vec.data(), m_Dim); }
+            //  scale the cached norm under *= instead of dropping it, may
+            //  differ from a recomputed norm by rounding
+            bool getIncrementalNorm() const { return m_Incremental; }
+            void setIncrementalNorm(bool incremental) { m_Incremental = incremental; }
+
+            //  operator overloads, bounds checked in CUBICAL_CHECKED builds
+            T operator()(unsigned int i) const;
+            //  drops the cached norm, the entry may be written through
+            T& operator()(unsigned int i);
+            //  addition and subtraction, a + b and a - b are expressions
+            template<typename E>
+            void operator+=(const VectorExpression<E>& other);
+            template<typename E>
+            void operator-=(const VectorExpression<E>& other);
+            //  scalar multiplication, a * scalar is an expression
+            void operator*=(const T scalar);
+            //  is equal
+            bool operator==(const Vector<T, Dynamic, Alloc>& other) const;
+            //  dot product
+            T operator*(const Vector<T, Dynamic, Alloc>& other) const;
+            //  Norm and squared norm are computed on first use and cached
+            //  until the vector is modified, so repeated calls are free.
+            T getSquaredNorm() const;
+            T getNorm() const;
+            //  recomputes the cached norm
+            void findNorm();
+            void normalize();
+            //  cross product 
+            Vector<T, Dynamic, Alloc> cross(const Vector<T, Dynamic, Alloc>& other) const;
+            //  projection
+            Vector<T, Dynamic, Alloc> projection(const Vector<T, Dynamic, Alloc>& other) const;
+
+            void print();
+
+        private:
+            //  size
+            unsigned int m_Dim;
+            //  vector
+            std::vector<T, Alloc> m_Vec;
+            //  cached squared norm and norm, each valid only if its flag is set
+            mutable T m_SquaredNorm;
+            mutable T m_Norm;
+            mutable bool m_SquaredNormValid;
+            mutable bool m_NormValid;
+            bool m_Incremental;
+
+            void invalidateNorm() { m_SquaredNormValid = false; m_NormValid = false; }
+    };
+
+    template<typename T, typename Alloc>
+    Vector<T, Dynamic, Alloc>::Vector()
+    : m_Dim(0), m_SquaredNorm(), m_Norm(), m_SquaredNormValid(false), m_NormValid(false), m_Incremental(false)
+    {
+
+    }
+
+    template<typename T, typename Alloc>
+    Vector<T, Dynamic, Alloc>::~Vector()
+    {
+
+    }
+
+    template<typename T, typename Alloc>
+    Vector<T, Dynamic, Alloc>::Vector(std::vector<T, Alloc> vec)
+    : m_Vec(std::move(vec)), m_SquaredNorm(), m_Norm(), m_SquaredNormValid(false), m_NormValid(false), m_Incremental(false)
+    {
+        m_Dim = m_Vec.size();
+    }
+
+    template<typename T, typename Alloc>
+    Vector<T, Dynamic, Alloc>::Vector(Vector<T, Dynamic, Alloc>&& other) noexcept
+    : m_Dim(other.m_Dim), m_Vec(std::move(other.m_Vec)), m_SquaredNorm(other.m_SquaredNorm), m_Norm(other.m_Norm),
+      m_SquaredNormValid(other.m_SquaredNormValid), m_NormValid(other.m_NormValid), m_Incremental(other.m_Incremental)
+    {
+        other.m_Dim = 0;
+        other.m_Vec.clear();
+        other.invalidateNorm();
+    }
+
+    template<typename T, typename Alloc>
+    Vector<T, Dynamic, Alloc>& Vector<T, Dynamic, Alloc>::operator=(Vector<T, Dynamic, Alloc>&& other) noexcept
+    {
+        if(this != &other)
         {
-            std::cout << "ERROR! Vectors are not compatible!" << std::endl;
-            return;
+            m_Dim = other.m_Dim;
+            m_Vec = std::move(other.m_Vec);
+            m_SquaredNorm = other.m_SquaredNorm;
+            m_Norm = other.m_Norm;
+            m_SquaredNormValid = other.m_SquaredNormValid;
+            m_NormValid = other.m_NormValid;
+            m_Incremental = other.m_Incremental;
+            other.m_Dim = 0;
+            other.m_Vec.clear();
+            other.invalidateNorm();
         }
-        else
+        return *this;
+    }
+
+    template<typename T, typename Alloc>
+    T Vector<T, Dynamic, Alloc>::operator()(unsigned int i) const
+    {
+#ifdef CUBICAL_CHECKED
+        if(i >= m_Dim)
         {
-            for(unsigned int i = 0; i < m_Dim; i++)
-            {
-                m_Vec[i] -= other(i);
-            }
+            throwIndexError(i, m_Dim);
+        }
+#endif
+        return m_Vec[i];
+    }
+
+    template<typename T, typename Alloc>
+    T& Vector<T, Dynamic, Alloc>::operator()(unsigned int i)
+    {
+#ifdef CUBICAL_CHECKED
+        if(i >= m_Dim)
+        {
+            throwIndexError(i, m_Dim);
         }
+#endif
+        invalidateNorm();
+        return m_Vec[i];
+    }
+
+    template<typename T, typename Alloc>
+    template<typename E>
+    Vector<T, Dynamic, Alloc>::Vector(const VectorExpression<E>& expression)
+    : m_Dim(0), m_SquaredNorm(), m_Norm(), m_SquaredNormValid(false), m_NormValid(false), m_Incremental(false)
+    {
+        *this = expression;
     }
 
-    template<typename T>
-    Vector<T> Vector<T>::operator*(const T scalar) const
+    template<typename T, typename Alloc>
+    template<typename E>
+    Vector<T, Dynamic, Alloc>& Vector<T, Dynamic, Alloc>::operator=(const VectorExpression<E>& expression)
     {
-        std::vector<T> temp;
+        const E& e = expression.self();
+        invalidateNorm();
+        if(!e.isValid())
+        {
+            //  incompatible operands, evaluate with checks into a
+            //  copy since this may appear in the expression
+            std::vector<T, Alloc> temp(e.getDim(), T(), m_Vec.get_allocator());
+            for(unsigned int i = 0; i < e.getDim(); i++)
+            {
+                temp[i] = e.get(i);
+            }
+            m_Vec.swap(temp);
+            m_Dim = m_Vec.size();
+            return *this;
+        }
+        m_Dim = e.getDim();
+        m_Vec.resize(m_Dim);
         for(unsigned int i = 0; i < m_Dim; i++)
         {
-            temp.push_back(m_Vec[i] * scalar);
+            m_Vec[i] = e.getUnchecked(i);
         }
-        return Vector<T>(temp);
+        return *this;
+    }
+
+    template<typename T, typename Alloc>
+    template<typename E>
+    void Vector<T, Dynamic, Alloc>::operator+=(const VectorExpression<E>& other)
+    {
+        *this = *this + other;
     }
 
-    template<typename T>
-    void Vector<T>::operator*=(const T scalar)
+    template<typename T, typename Alloc>
+    template<typename E>
+    void Vector<T, Dynamic, Alloc>::operator-=(const VectorExpression<E>& other)
+    {
+        *this = *this - other;
+    }
+
+    template<typename T, typename Alloc>
+    void Vector<T, Dynamic, Alloc>::operator*=(const T scalar)
     {
         for(unsigned int i = 0; i < m_Dim; i++)
         {
             m_Vec[i] *= scalar;
         }
+        if(!m_Incremental)
+        {
+            invalidateNorm();
+            return;
+        }
+        //  |s v|^2 = s^2 |v|^2 and |s v| = |s| |v|
+        m_SquaredNorm *= scalar * scalar;
+        m_Norm *= scalar < T() ? -scalar : scalar;
     }
 
-    template<typename T>
-    bool Vector<T>::operator==(const Vector<T>& other) const
+    template<typename T, typename Alloc>
+    bool Vector<T, Dynamic, Alloc>::operator==(const Vector<T, Dynamic, Alloc>& other) const
     {
         if(m_Dim != other.getDim())
         {
@@ -211,71 +514,76 @@ namespace Cubical
         return true;
     }
 
-    template<typename T>
-    T Vector<T>::operator*(const Vector<T>& other) const
+    template<typename T, typename Alloc>
+    T Vector<T, Dynamic, Alloc>::operator*(const Vector<T, Dynamic, Alloc>& other) const
     {
-        T dot;
         if(m_Dim != other.getDim())
         {
             std::cout << "ERROR! Vectors are not compatible!" << std::endl;
-            return 0;
+            return T();
         }
-        else
+        T dot = T();
+        for(unsigned int i = 0; i < m_Dim; i++)
         {
-            for(unsigned int i = 0; i < m_Dim; i++)
-            {
-                dot += m_Vec[i] * other(i);
-            }
+            dot += m_Vec[i] * other.get(i);
         }
         return dot;
     }
 
-    template<typename T>
-    void Vector<T>::findNorm()
+    template<typename T, typename Alloc>
+    T Vector<T, Dynamic, Alloc>::getSquaredNorm() const
     {
-        T norm;
-        for(unsigned int i = 0; i < m_Dim; i++)
+        if(!m_SquaredNormValid)
         {
-            norm += m_Vec[i] * m_Vec[i];
+            T norm = T();
+            for(unsigned int i = 0; i < m_Dim; i++)
+            {
+                norm += m_Vec[i] * m_Vec[i];
+            }
+            m_SquaredNorm = norm;
+            m_SquaredNormValid = true;
         }
-        m_Norm = sqrt(norm);
+        return m_SquaredNorm;
     }
 
-    template<typename T>
-    void Vector<T>::normalize()
+    template<typename T, typename Alloc>
+    T Vector<T, Dynamic, Alloc>::getNorm() const
     {
-        if(!m_Norm)
+        if(!m_NormValid)
         {
-            findNorm();
+            m_Norm = T(std::sqrt(getSquaredNorm()));
+            m_NormValid = true;
         }
-        if(m_Norm == 0)
+        return m_Norm;
+    }
+
+    template<typename T, typename Alloc>
+    void Vector<T, Dynamic, Alloc>::findNorm()
+    {
+        invalidateNorm();
+        getNorm();
+    }
+
+    template<typename T, typename Alloc>
+    void Vector<T, Dynamic, Alloc>::normalize()
+    {
+        T norm = getNorm();
+        if(norm == T())
         {
             std::cout << "ERROR! Vector is the zero vector!" << std::endl;
             return;
         }
-        else
-        {
-            for(unsigned int i = 0; i < m_Dim; i++)
-            {
-                m_Vec[i] /= m_Norm;
-            }
-        }
-    }
-
-    template<typename T>
-    T const Vector<T>::getNorm()
-    {
-        if(!m_Norm)
+        for(unsigned int i = 0; i < m_Dim; i++)
         {
-            findNorm();
+            m_Vec[i] /= norm;
         }
-        return m_Norm;
+        invalidateNorm();
     }
 
-    template<typename T>
-    Vector<T> Vector<T>::cross(const Vector<T>& other) const
+    template<typename T, typename Alloc>
+    Vector<T, Dynamic, Alloc> Vector<T, Dynamic, Alloc>::cross(const Vector<T, Dynamic, Alloc>& other) const
     {
-        std::vector<T> temp;
+        std::vector<T, Alloc> temp(m_Vec.get_allocator());
         if(m_Dim != 3 || other.getDim() != 3)
         {
             std::cout << "ERROR! Cross product not defined for vectors of dimension " << m_Dim << " and " << other.getDim() << std::endl;
@@ -287,13 +595,13 @@ namespace Cubical
             temp.push_back(m_Vec[2] * other(0) - m_Vec[0] * other(2));
             temp.push_back(m_Vec[0] * other(1) - m_Vec[1] * other(0));
         }
-        return Vector<T>(temp);
+        return Vector<T, Dynamic, Alloc>(temp);
     }
 
-    template<typename T>
-    Vector<T> Vector<T>::projection(const Vector<T>& other) const
+    template<typename T, typename Alloc>
+    Vector<T, Dynamic, Alloc> Vector<T, Dynamic, Alloc>::projection(const Vector<T, Dynamic, Alloc>& other) const
     {
-        std::vector<T> temp;
+        std::vector<T, Alloc> temp(m_Vec.get_allocator());
         temp = m_Vec;
         if(m_Dim != other.getDim())
         {
@@ -302,18 +610,23 @@ namespace Cubical
         else
         {
             T dot = (*this) * other;
-            T norm_s = (*this) * (*this);
-            dot /= norm_s;
+            T norm = getSquaredNorm();
+            if(norm == T())
+            {
+                std::cout << "ERROR! Vector is the zero vector!" << std::endl;
+                return Vector<T, Dynamic, Alloc>(temp);
+            }
+            dot /= norm;
             for(unsigned int i = 0; i < m_Dim; i++)
             {
                 temp[i] *= dot;
             }
         }
-        return Vector<T>(temp);
+        return Vector<T, Dynamic, Alloc>(temp);
     }
 
-    template<typename T>
-    void Vector<T>::print()
+    template<typename T, typename Alloc>
+    void Vector<T, Dynamic, Alloc>::print()
     {
         std::cout << "\n[ ";
         for(unsigned int i = 0; i < m_Dim; i++)
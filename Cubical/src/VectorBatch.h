@@ -0,0 +1,363 @@
+#pragma once
+
+#include <vector>
+#include <iostream>
+#include <thread>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
+
+#include "Gemm.h"
+#include "Vector.h"
+
+namespace Cubical
+{
+    //  SIMD lanes of the batched kernels. Arithmetic types of 4 or 8
+    //  bytes are processed a register at a time, others one at a time.
+    template<typename T, bool = std::is_arithmetic<T>::value && (sizeof(T) == 4 || sizeof(T) == 8)>
+    struct BatchLanes
+    {
+        typedef T Lane;
+        static const unsigned int L = 1;
+        static Lane load(const T* p) { return *p; }
+        static void store(T* p, const Lane& value) { *p = value; }
+        static T sum(const Lane& value) { return value; }
+    };
+
+    template<typename T>
+    struct BatchLanes<T, true>
+    {
+        typedef T Lane __attribute__((vector_size(GemmVectorBytes)));
+        static const unsigned int L = GemmVectorBytes / sizeof(T);
+        static Lane load(const T* p)
+        {
+            Lane value;
+            std::memcpy(&value, p, sizeof(Lane));
+            return value;
+        }
+        static void store(T* p, const Lane& value) { std::memcpy(p, &value, sizeof(Lane)); }
+        static T sum(const Lane& value)
+        {
+            T total = T();
+            for(unsigned int k = 0; k < L; k++)
+            {
+                total += value[k];
+            }
+            return total;
+        }
+    };
+
+    //  elements handled per block, and the smallest share of a thread
+    const size_t BatchBlock = 256;
+
+    //  Many vectors of the same dimension in structure-of-arrays layout,
+    //  component k of vector i at getComponent(k)[i]. Each component
+    //  array is padded to a multiple of 16 elements.
+    template<typename T, typename Alloc = std::allocator<T> >
+    class VectorBatch
+    {
+        public:
+            VectorBatch<T, Alloc>(unsigned int dim, size_t count, const Alloc& alloc = Alloc())
+            : m_Dim(dim), m_Count(count), m_Stride((count + 15) / 16 * 16), m_Data(m_Stride * dim, T(), alloc) {}
+            virtual ~VectorBatch<T, Alloc>() {}
+
+            //  getters and setters
+            unsigned int getDim() const { return m_Dim; }
+            size_t getCount() const { return m_Count; }
+            const T* getComponent(unsigned int k) const { return m_Data.data() + k * m_Stride; }
+            T* getComponent(unsigned int k) { return m_Data.data() + k * m_Stride; }
+            T get(size_t i, unsigned int k) const { return getComponent(k)[i]; }
+            void set(size_t i, unsigned int k, const T value) { getComponent(k)[i] = value; }
+            //  copies vector i in or out
+            template<unsigned int N, typename A>
+            void set(size_t i, const Vector<T, N, A>& vector);
+            template<unsigned int N>
+            Vector<T, N> getVector(size_t i) const;
+
+        private:
+            unsigned int m_Dim;
+            size_t m_Count;
+            size_t m_Stride;
+            std::vector<T, Alloc> m_Data;
+    };
+
+    template<typename T, typename Alloc>
+    template<unsigned int N, typename A>
+    void VectorBatch<T, Alloc>::set(size_t i, const Vector<T, N, A>& vector)
+    {
+        if(vector.getDim() != m_Dim)
+        {
+            std::cout << "ERROR! Vector of dimension " << vector.getDim() << " does not fit batch of dimension " << m_Dim << "!" << std::endl;
+            return;
+        }
+        for(unsigned int k = 0; k < m_Dim; k++)
+        {
+            getComponent(k)[i] = vector.get(k);
+        }
+    }
+
+    template<typename T, typename Alloc>
+    template<unsigned int N>
+    Vector<T, N> VectorBatch<T, Alloc>::getVector(size_t i) const
+    {
+        static_assert(N != Dynamic, "getVector needs a fixed dimension!");
+        Vector<T, N> vector;
+        if(N != m_Dim)
+        {
+            std::cout << "ERROR! Vector of dimension " << N << " does not fit batch of dimension " << m_Dim << "!" << std::endl;
+            return vector;
+        }
+        for(unsigned int k = 0; k < N; k++)
+        {
+            vector(k) = getComponent(k)[i];
+        }
+        return vector;
+    }
+
+    //  runs f(begin, end) over [0, count) split into whole blocks
+    //  across at most the given number of threads
+    template<typename F>
+    void batchRun(size_t count, unsigned int threads, F f)
+    {
+        size_t blocks = (count + BatchBlock - 1) / BatchBlock;
+        threads = (unsigned int)std::max((size_t)1, std::min((size_t)threads, blocks));
+        if(threads == 1)
+        {
+            f((size_t)0, count);
+            return;
+        }
+        std::vector<std::thread> workers;
+        for(unsigned int t = 0; t < threads; t++)
+        {
+            size_t begin = std::min(count, blocks * t / threads * BatchBlock);
+            size_t end = std::min(count, blocks * (t + 1) / threads * BatchBlock);
+            workers.push_back(std::thread(f, begin, end));
+        }
+        for(unsigned int t = 0; t < threads; t++)
+        {
+            workers[t].join();
+        }
+    }
+
+    //  out[i - begin] = sum over k of a[k][i] * b[k][i] for i in [begin, end)
+    template<typename T>
+    void batchDotRange(unsigned int dim, const T* const* a, const T* const* b, T* out, size_t begin, size_t end)
+    {
+        typedef BatchLanes<T> V;
+        size_t i = begin;
+        for(; i + V::L <= end; i += V::L)
+        {
+            typename V::Lane sum = V::load(a[0] + i) * V::load(b[0] + i);
+            for(unsigned int k = 1; k < dim; k++)
+            {
+                sum += V::load(a[k] + i) * V::load(b[k] + i);
+            }
+            V::store(out + i - begin, sum);
+        }
+        for(; i < end; i++)
+        {
+            T sum = T();
+            for(unsigned int k = 0; k < dim; k++)
+            {
+                sum += a[k][i] * b[k][i];
+            }
+            out[i - begin] = sum;
+        }
+    }
+
+    //  out[k][i] = a[k][i] * scale[i - begin] for i in [begin, end)
+    template<typename T>
+    void batchScaleRange(unsigned int dim, const T* const* a, const T* scale, T* const* out, size_t begin, size_t end)
+    {
+        typedef BatchLanes<T> V;
+        for(unsigned int k = 0; k < dim; k++)
+        {
+            size_t i = begin;
+            for(; i + V::L <= end; i += V::L)
+            {
+                V::store(out[k] + i, V::load(a[k] + i) * V::load(scale + i - begin));
+            }
+            for(; i < end; i++)
+            {
+                out[k][i] = a[k][i] * scale[i - begin];
+            }
+        }
+    }
+
+    template<typename T, typename A>
+    std::vector<const T*> getComponents(const VectorBatch<T, A>& batch)
+    {
+        std::vector<const T*> components(batch.getDim());
+        for(unsigned int k = 0; k < batch.getDim(); k++)
+        {
+            components[k] = batch.getComponent(k);
+        }
+        return components;
+    }
+
+    template<typename T, typename A>
+    std::vector<T*> getComponents(VectorBatch<T, A>& batch)
+    {
+        std::vector<T*> components(batch.getDim());
+        for(unsigned int k = 0; k < batch.getDim(); k++)
+        {
+            components[k] = batch.getComponent(k);
+        }
+        return components;
+    }
+
+    template<typename T, typename A, typename B>
+    bool batchCompatible(const VectorBatch<T, A>& a, const VectorBatch<T, B>& b)
+    {
+        if(a.getDim() != b.getDim() || a.getCount() != b.getCount())
+        {
+            std::cout << "ERROR! Batches are not compatible!" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    //  out[i] = a_i * b_i, out holds a.getCount() values
+    template<typename T, typename A, typename B>
+    void batchDot(const VectorBatch<T, A>& a, const VectorBatch<T, B>& b, T* out, unsigned int threads = 1)
+    {
+        if(!batchCompatible(a, b) || a.getDim() == 0)
+        {
+            return;
+        }
+        std::vector<const T*> ca = getComponents(a);
+        std::vector<const T*> cb = getComponents(b);
+        batchRun(a.getCount(), threads, [&](size_t begin, size_t end)
+        {
+            batchDotRange(a.getDim(), ca.data(), cb.data(), out + begin, begin, end);
+        });
+    }
+
+    template<typename T, typename A>
+    void batchSquaredNorm(const VectorBatch<T, A>& a, T* out, unsigned int threads = 1)
+    {
+        batchDot(a, a, out, threads);
+    }
+
+    template<typename T, typename A>
+    void batchNorm(const VectorBatch<T, A>& a, T* out, unsigned int threads = 1)
+    {
+        if(a.getDim() == 0)
+        {
+            return;
+        }
+        std::vector<const T*> ca = getComponents(a);
+        batchRun(a.getCount(), threads, [&](size_t begin, size_t end)
+        {
+            batchDotRange(a.getDim(), ca.data(), ca.data(), out + begin, begin, end);
+            for(size_t i = begin; i < end; i++)
+            {
+                out[i] = T(std::sqrt(out[i]));
+            }
+        });
+    }
+
+    //  scales every vector to unit length, zero vectors are left as they are
+    template<typename T, typename A>
+    void batchNormalize(VectorBatch<T, A>& a, unsigned int threads = 1)
+    {
+        if(a.getDim() == 0)
+        {
+            return;
+        }
+        std::vector<const T*> ca = getComponents((const VectorBatch<T, A>&)a);
+        std::vector<T*> out = getComponents(a);
+        batchRun(a.getCount(), threads, [&](size_t begin, size_t end)
+        {
+            T scale[BatchBlock];
+            for(size_t b = begin; b < end; b += BatchBlock)
+            {
+                size_t e = std::min(end, b + BatchBlock);
+                batchDotRange(a.getDim(), ca.data(), ca.data(), scale, b, e);
+                for(size_t i = 0; i < e - b; i++)
+                {
+                    T norm = T(std::sqrt(scale[i]));
+                    scale[i] = norm == T() ? T(1) : T(1) / norm;
+                }
+                batchScaleRange(a.getDim(), ca.data(), scale, out.data(), b, e);
+            }
+        });
+    }
+
+    //  out_i = a_i x b_i, all of dimension 3
+    template<typename T, typename A, typename B, typename C>
+    void batchCross(const VectorBatch<T, A>& a, const VectorBatch<T, B>& b, VectorBatch<T, C>& out, unsigned int threads = 1)
+    {
+        if(!batchCompatible(a, b) || !batchCompatible(a, out))
+        {
+            return;
+        }
+        if(a.getDim() != 3)
+        {
+            std::cout << "ERROR! Cross product not defined for vectors of dimension " << a.getDim() << std::endl;
+            return;
+        }
+        const T* a0 = a.getComponent(0);
+        const T* a1 = a.getComponent(1);
+        const T* a2 = a.getComponent(2);
+        const T* b0 = b.getComponent(0);
+        const T* b1 = b.getComponent(1);
+        const T* b2 = b.getComponent(2);
+        T* c0 = out.getComponent(0);
+        T* c1 = out.getComponent(1);
+        T* c2 = out.getComponent(2);
+        batchRun(a.getCount(), threads, [&](size_t begin, size_t end)
+        {
+            typedef BatchLanes<T> V;
+            size_t i = begin;
+            for(; i + V::L <= end; i += V::L)
+            {
+                typename V::Lane x0 = V::load(a0 + i), x1 = V::load(a1 + i), x2 = V::load(a2 + i);
+                typename V::Lane y0 = V::load(b0 + i), y1 = V::load(b1 + i), y2 = V::load(b2 + i);
+                V::store(c0 + i, x1 * y2 - x2 * y1);
+                V::store(c1 + i, x2 * y0 - x0 * y2);
+                V::store(c2 + i, x0 * y1 - x1 * y0);
+            }
+            for(; i < end; i++)
+            {
+                T x0 = a0[i], x1 = a1[i], x2 = a2[i];
+                T y0 = b0[i], y1 = b1[i], y2 = b2[i];
+                c0[i] = x1 * y2 - x2 * y1;
+                c1[i] = x2 * y0 - x0 * y2;
+                c2[i] = x0 * y1 - x1 * y0;
+            }
+        });
+    }
+
+    //  out_i = a_i.projection(b_i), that is (a_i * b_i / a_i * a_i) a_i,
+    //  zero vectors a_i are copied unchanged
+    template<typename T, typename A, typename B, typename C>
+    void batchProjection(const VectorBatch<T, A>& a, const VectorBatch<T, B>& b, VectorBatch<T, C>& out, unsigned int threads = 1)
+    {
+        if(!batchCompatible(a, b) || !batchCompatible(a, out) || a.getDim() == 0)
+        {
+            return;
+        }
+        std::vector<const T*> ca = getComponents(a);
+        std::vector<const T*> cb = getComponents(b);
+        std::vector<T*> co = getComponents(out);
+        batchRun(a.getCount(), threads, [&](size_t begin, size_t end)
+        {
+            T dot[BatchBlock];
+            T norm[BatchBlock];
+            for(size_t k = begin; k < end; k += BatchBlock)
+            {
+                size_t e = std::min(end, k + BatchBlock);
+                batchDotRange(a.getDim(), ca.data(), cb.data(), dot, k, e);
+                batchDotRange(a.getDim(), ca.data(), ca.data(), norm, k, e);
+                for(size_t i = 0; i < e - k; i++)
+                {
+                    dot[i] = norm[i] == T() ? T(1) : dot[i] / norm[i];
+                }
+                batchScaleRange(a.getDim(), ca.data(), dot, co.data(), k, e);
+            }
+        });
+    }
+
+}
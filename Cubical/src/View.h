@@ -0,0 +1,127 @@
+#pragma once
+
+#include <type_traits>
+
+#include "Error.h"
+#include "Expression.h"
+
+namespace Cubical
+{
+    //  row i of a column-major matrix, entry j is data[lines[j] * stride]
+    template<typename T>
+    struct StridedRow
+    {
+        T* data;
+        const unsigned int* lines;
+        size_t stride;
+        T& operator[](unsigned int j) const { return data[(size_t)lines[j] * stride]; }
+    };
+
+    //  Non-owning views of the storage of a Matrix or Vector. A view is two
+    //  or three pointers and the sizes, so it is passed by value and never
+    //  copies entries. T is const for read-only views. A view follows row
+    //  exchanges of its matrix but is invalidated once the matrix or vector
+    //  is resized, moved or destroyed. Views are expressions, so a + v * 2
+    //  works for views as for matrices and vectors.
+    //
+    //  Matrix storage is a sequence of lines, rows in a row-major view and
+    //  columns in a column-major one, each placed by a permutation. Reading
+    //  row-major storage as column-major with n and m swapped transposes
+    //  the matrix without touching it.
+    template<typename T, Layout L = RowMajor>
+    class MatrixView : public MatrixExpression<MatrixView<T, L> >
+    {
+        public:
+            typedef typename std::remove_const<T>::type value_type;
+            typedef typename std::conditional<L == RowMajor, T*, StridedRow<T> >::type Row;
+
+            MatrixView() : m_N(0), m_M(0), m_Data(nullptr), m_Lines(nullptr) {}
+            //  entry (i,j) is data[lines[i] * m + j] in a row-major view
+            //  and data[lines[j] * n + i] in a column-major one
+            MatrixView(T* data, const unsigned int* lines, unsigned int n, unsigned int m)
+            : m_N(n), m_M(m), m_Data(data), m_Lines(lines) {}
+            //  a writable view converts to a read-only one
+            template<typename U, typename = typename std::enable_if<std::is_convertible<U*, T*>::value>::type>
+            MatrixView(const MatrixView<U, L>& other)
+            : m_N(other.getN()), m_M(other.getM()), m_Data(other.getData()), m_Lines(other.getLines()) {}
+
+            //  getters and setters
+            unsigned int getN() const { return m_N; }
+            unsigned int getM() const { return m_M; }
+            static Layout getLayout() { return L; }
+            T* getData() const { return m_Data; }
+            const unsigned int* getLines() const { return m_Lines; }
+            //  unchecked access used by expressions
+            Row getRow(unsigned int i) const
+            {
+                if constexpr(L == RowMajor)
+                {
+                    return m_Data + (size_t)m_Lines[i] * m_M;
+                }
+                else
+                {
+                    return Row{m_Data + i, m_Lines, m_N};
+                }
+            }
+            value_type get(unsigned int i, unsigned int j) const { return getRow(i)[j]; }
+            bool isValid() const { return true; }
+
+            //  bounds checked in CUBICAL_CHECKED builds
+            T& operator()(unsigned int i, unsigned int j) const
+            {
+#ifdef CUBICAL_CHECKED
+                if(i >= m_N || j >= m_M)
+                {
+                    throwIndexError(i, j, m_N, m_M);
+                }
+#endif
+                return getRow(i)[j];
+            }
+
+        private:
+            unsigned int m_N;
+            unsigned int m_M;
+            T* m_Data;
+            const unsigned int* m_Lines;
+    };
+
+    template<typename T>
+    class VectorView : public VectorExpression<VectorView<T> >
+    {
+        public:
+            typedef typename std::remove_const<T>::type value_type;
+            static const unsigned int Dim = Dynamic;
+
+            VectorView() : m_Dim(0), m_Data(nullptr) {}
+            VectorView(T* data, unsigned int dim) : m_Dim(dim), m_Data(data) {}
+            template<typename U, typename = typename std::enable_if<std::is_convertible<U*, T*>::value>::type>
+            VectorView(const VectorView<U>& other) : m_Dim(other.getDim()), m_Data(other.getData()) {}
+
+            //  getters and setters
+            unsigned int getDim() const { return m_Dim; }
+            T* getData() const { return m_Data; }
+            T* begin() const { return m_Data; }
+            T* end() const { return m_Data + m_Dim; }
+            //  unchecked access used by expressions
+            value_type get(unsigned int i) const { return m_Data[i]; }
+            value_type getUnchecked(unsigned int i) const { return m_Data[i]; }
+            bool isValid() const { return true; }
+
+            //  bounds checked in CUBICAL_CHECKED builds
+            T& operator()(unsigned int i) const
+            {
+#ifdef CUBICAL_CHECKED
+                if(i >= m_Dim)
+                {
+                    throwIndexError(i, m_Dim);
+                }
+#endif
+                return m_Data[i];
+            }
+
+        private:
+            unsigned int m_Dim;
+            T* m_Data;
+    };
+
+}
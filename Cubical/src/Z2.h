@@ -0,0 +1,45 @@
+#pragma once
+
+#include <iostream>
+
+namespace Cubical
+{
+    //  element of the field with two elements,
+    //  addition and subtraction are both xor
+    class Z2
+    {
+        public:
+            Z2() : m_Value(0) {}
+            Z2(int value) : m_Value(value & 1) {}
+
+            //  getters and setters
+            unsigned char getValue() const { return m_Value; }
+
+            //  operator overloads
+            explicit operator bool() const { return m_Value != 0; }
+            Z2 operator-() const { return *this; }
+            //  addition
+            Z2 operator+(const Z2 other) const { return Z2(m_Value ^ other.m_Value); }
+            void operator+=(const Z2 other) { m_Value ^= other.m_Value; }
+            //  subtraction
+            Z2 operator-(const Z2 other) const { return Z2(m_Value ^ other.m_Value); }
+            void operator-=(const Z2 other) { m_Value ^= other.m_Value; }
+            //  multiplication
+            Z2 operator*(const Z2 other) const { return Z2(m_Value & other.m_Value); }
+            void operator*=(const Z2 other) { m_Value &= other.m_Value; }
+            //  division, only defined for a non-zero divisor
+            Z2 operator/(const Z2 other) const { return Z2(m_Value & other.m_Value); }
+            void operator/=(const Z2 other) { m_Value &= other.m_Value; }
+            //  comparison
+            bool operator==(const Z2 other) const { return m_Value == other.m_Value; }
+            bool operator!=(const Z2 other) const { return m_Value != other.m_Value; }
+
+        private:
+            unsigned char m_Value;
+    };
+
+    inline std::ostream& operator<<(std::ostream& os, const Z2 value)
+    {
+        return os << (int)value.getValue();
+    }
+}
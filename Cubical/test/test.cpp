@@ -0,0 +1,196 @@
+//  Self-checking tests of the persistence modes and the matrix product.
+//  Build from this directory with
+//
+//      g++ -std=c++17 -O2 -pthread -I../src test.cpp -o test
+//
+//  and run as ./test, which prints every failed check and exits with the
+//  number of failures. Bounds checks stay on unless NDEBUG is defined,
+//  and the tests are meant to be run under sanitizers as well.
+#include <cstdio>
+#include <random>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <algorithm>
+
+#include "Matrix.h"
+#include "ModP.h"
+#include "CubicalComplex.h"
+#include "Persistence.h"
+#include "StreamingPersistence.h"
+#include "MorseComplex.h"
+#include "Z2.h"
+
+using namespace Cubical;
+
+unsigned int failures = 0;
+
+void check(bool ok, const std::string& what)
+{
+    if(!ok)
+    {
+        std::printf("FAILED %s\n", what.c_str());
+        failures++;
+    }
+}
+
+//  pairs in a canonical order, as the modes emit them differently
+typedef std::tuple<unsigned int, double, double, bool> Pair;
+
+std::vector<Pair> sorted(const std::vector<PersistencePair<double> >& pairs)
+{
+    std::vector<Pair> result;
+    for(size_t k = 0; k < pairs.size(); k++)
+    {
+        result.push_back(Pair(pairs[k].dim, pairs[k].birth, pairs[k].death, pairs[k].essential));
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+//  Random grids of one to three dimensions, with few distinct values so
+//  that the filtration has many ties. Every mode must give the pairs of
+//  the plain standard algorithm.
+void checkPersistence(std::mt19937& rng)
+{
+    size_t spilled = 0;
+    for(unsigned int t = 0; t < 60; t++)
+    {
+        std::vector<unsigned int> shape(1 + t % 3);
+        size_t size = 1;
+        for(unsigned int a = 0; a < shape.size(); a++)
+        {
+            shape[a] = 1 + rng() % (shape.size() == 1 ? 40 : shape.size() == 2 ? 14 : 7);
+            size *= shape[a];
+        }
+        std::vector<double> grid(size);
+        unsigned int levels = 2 + rng() % 6;
+        for(size_t k = 0; k < size; k++)
+        {
+            grid[k] = rng() % levels;
+        }
+        CubicalComplex<double> complex(grid, shape);
+        CubicalComplex<double> implicit(grid, shape, true);
+        std::vector<Pair> expected = sorted(Persistence<double>(complex, false, false, 1, false).getPairs());
+        std::string name = "grid " + std::to_string(t) + ": ";
+        for(unsigned int mode = 1; mode < 8; mode++)
+        {
+            bool clearing = mode & 1;
+            bool cohomology = mode & 2;
+            bool apparent = mode & 4;
+            Persistence<double> p(complex, clearing, cohomology, 1, apparent);
+            check(sorted(p.getPairs()) == expected, name + "clearing " + std::to_string(clearing) + ", cohomology "
+                  + std::to_string(cohomology) + ", apparent " + std::to_string(apparent));
+        }
+        check(sorted(Persistence<double>(complex, true, false, 3).getPairs()) == expected, name + "threads");
+        check(sorted(Persistence<double>(complex, true, true, 3).getPairs()) == expected, name + "threads, cohomology");
+        check(sorted(Persistence<double>(implicit).getPairs()) == expected, name + "implicit complex");
+        //  enough for the bookkeeping and a few hundred bytes of columns
+        size_t bookkeeping = complex.getCells() * 3 * sizeof(unsigned int) + complex.getCells() / 8 + complex.getBytes();
+        StreamingPersistence<double> streaming(complex, (bookkeeping + 512) * 8 / 7 + 8);
+        check(sorted(streaming.getPairs()) == expected, name + "streaming");
+        spilled += streaming.getStore().getSpilledColumns();
+        check(sorted(MorseComplex<double>(complex).getPersistence()) == expected, name + "morse");
+        check(sorted(MorseComplex<double>(complex, 3).getPersistence()) == expected, name + "morse, threads");
+    }
+    check(spilled > 0, "streaming never spilled a column");
+}
+
+template<typename T, Layout L>
+Matrix<T, std::allocator<T>, L> randomMatrix(unsigned int n, unsigned int m, std::mt19937& rng)
+{
+    Matrix<T, std::allocator<T>, L> a(n, m);
+    for(unsigned int i = 0; i < n; i++)
+    {
+        for(unsigned int j = 0; j < m; j++)
+        {
+            a(i, j) = T((int)(rng() % 7) - 3);
+        }
+    }
+    return a;
+}
+
+//  Products of small integers are exact in every type, so the blocked
+//  product must match the naive one entry for entry. Sizes cover the
+//  direct path for small products, partial tiles and several blocks,
+//  and line exchanges check that permuted lines are followed.
+template<typename T, Layout L>
+void checkGemm(const std::string& type, std::mt19937& rng)
+{
+    typedef Matrix<T, std::allocator<T>, L> M;
+    const unsigned int sizes[][3] = { {1, 1, 1}, {3, 3, 3}, {5, 9, 2}, {13, 7, 70}, {37, 300, 45}, {100, 260, 130} };
+    std::string layout = L == RowMajor ? " row-major " : " column-major ";
+    for(const unsigned int* size : sizes)
+    {
+        unsigned int n = size[0];
+        unsigned int k = size[1];
+        unsigned int m = size[2];
+        M a = randomMatrix<T, L>(n, k, rng);
+        M b = randomMatrix<T, L>(k, m, rng);
+        a.rowExchange(0, n - 1);
+        b.columnExchange(0, m - 1);
+        M expected(n, m);
+        for(unsigned int i = 0; i < n; i++)
+        {
+            for(unsigned int j = 0; j < m; j++)
+            {
+                T sum = T();
+                for(unsigned int p = 0; p < k; p++)
+                {
+                    sum += a(i, p) * b(p, j);
+                }
+                expected(i, j) = sum;
+            }
+        }
+        std::string name = type + layout + std::to_string(n) + "x" + std::to_string(k) + "x" + std::to_string(m);
+        auto equal = [&](const M& c)
+        {
+            if(c.getN() != n || c.getM() != m)
+            {
+                return false;
+            }
+            for(unsigned int i = 0; i < n; i++)
+            {
+                for(unsigned int j = 0; j < m; j++)
+                {
+                    if(!(c(i, j) == expected(i, j)))
+                    {
+                        return false;
+                    }
+                }
+            }
+            return true;
+        };
+        M c;
+        c.multiply(a, b);
+        check(equal(c), name);
+        c.multiply(a, b, 3);
+        check(equal(c), name + " threads");
+        check(equal(a * b), name + " operator*");
+        M d = a;
+        d *= b;
+        check(equal(d), name + " operator*=");
+        M e = a;
+        e.multiply(e, b);
+        check(equal(e), name + " aliased");
+    }
+}
+
+int main()
+{
+    std::mt19937 rng(2024);
+    checkPersistence(rng);
+    checkGemm<double, RowMajor>("double", rng);
+    checkGemm<double, ColumnMajor>("double", rng);
+    checkGemm<float, RowMajor>("float", rng);
+    checkGemm<float, ColumnMajor>("float", rng);
+    checkGemm<int, RowMajor>("int", rng);
+    checkGemm<long, ColumnMajor>("long", rng);
+    checkGemm<short, RowMajor>("short", rng);
+    checkGemm<Z2, RowMajor>("Z2", rng);
+    checkGemm<Z2, ColumnMajor>("Z2", rng);
+    checkGemm<ModP<65521>, RowMajor>("ModP", rng);
+    checkGemm<ModP<65521>, ColumnMajor>("ModP", rng);
+    std::printf("%u failures\n", failures);
+    return failures;
+}